@@ -31,7 +31,20 @@ static void _rx_data_done(osjob_t *job);
 static void _tx_done(osjob_t *job);
 static void _tx_beacon_done(osjob_t *job);
 static void _tx_data_done(osjob_t *job);
+#if (TRUE == BLINK_USE_CAD) || (TRUE == BLINK_USE_LPL)
 static void _cad_done(osjob_t *job);
+#endif
+static void _scan_attempt(osjob_t *job);
+static void _scan_cad(osjob_t *job);
+static void _scan_cad_done(osjob_t *job);
+static void _ack_tx(osjob_t *job);
+static void _ack_rx(osjob_t *job);
+static void _ack_done(osjob_t *job);
+static void _down_tx(osjob_t *job);
+static void _rx_down_done(osjob_t *job);
+#if (TRUE == BLINK_USE_RX_PEEK)
+static void _rx_peek(osjob_t *job);
+#endif
 
 // utils
 static inline void _next_slot(void);
@@ -39,8 +52,70 @@ static inline u1_t _is_beacon_slot(void);
 static inline u1_t _is_data_slot(void);
 static void        _report_event(event_t ev);
 static void        _missed_beacon(void);
-static void        _rebroadcast_beacon(beacon_msg_t *b);
+static void        _rebroadcast_beacon(beacon_t *b);
 static void        _set_radio_callback(osjobcb_t callback);
+static ostime_t    _rx_start_time(void);
+static void        _schedule_rx(ostime_t expected, osjobcb_t callback);
+static void        _rx_stats(void);
+static ostime_t    _slot_start(u4_t slots);
+static void        _anchor(ostime_t slot_start);
+static void        _drift_sample(u4_t net_ms, ostime_t local);
+static void        _bcn_adapt(void);
+static void        _bcn_listen(void);
+static ostime_t    _scan_interval(void);
+static u2_t        _data_preamble(void);
+static void        _idle_stats(void);
+static void        _peek_start(ostime_t t);
+static void        _scan_resume(void);
+static u1_t        _cfg_valid(const struct blink_cfg_t *cfg);
+static void        _apply_config(void);
+static void        _beacon_config(beacon_t *b);
+static u1_t        _beacon_parse(beacon_t *b);
+static u1_t        _tlv_put(u1_t off, u1_t type, const void *value, u1_t len);
+static u2_t        _cfg_digest(const struct blink_cfg_t *cfg);
+static u1_t        _minislots(const struct blink_cfg_t *cfg);
+static void        _minislot_setup(void);
+static ostime_t    _minislot_time(u1_t k);
+static u1_t        _minislot_fits(ostime_t t);
+static void        _schedule_minislot(void);
+static void        _next_minislot(void);
+static u1_t        _frame_valid(packet_type_t type);
+static u1_t        _records_valid(void);
+static u1_t        _record_size(const record_t *r, u2_t sender);
+static u1_t        _record_pack(u1_t *buf, const record_t *r, u2_t sender);
+static u1_t        _record_unpack(u1_t off, record_t *r);
+static u1_t        _txq_put(u1_t cls, record_t *r);
+static record_t*   _txq_peek(u1_t classes, u1_t *cls);
+static void        _txq_pop(u1_t cls);
+static u2_t        _vslots(const struct blink_cfg_t *cfg);
+static inline u1_t _vslot_groups(const struct blink_cfg_t *cfg);
+static inline u2_t _vslot(u1_t k);
+static inline u1_t _hop_group(u1_t hop);
+static u2_t        _vslot_pick(void);
+static inline u2_t _source_vslot(void);
+static inline u2_t _forward_vslot(void);
+static u1_t        _vslot_listen(u2_t v);
+static u1_t        _tx_classes(void);
+static u1_t        _tx_ready(void);
+static void        _tx_continue(void);
+static void        _tx_finish(u1_t delivered);
+static void        _rx_continue(u1_t got);
+static ostime_t    _exchange_time(const struct blink_cfg_t *cfg);
+static void        _latency_stats(record_t *r);
+static struct blink_nbr_t* _nbr_find(u2_t id);
+static struct blink_nbr_t* _nbr_update(beacon_t *b);
+static void        _nbr_epoch(void);
+static u1_t        _link_etx(struct blink_nbr_t *e);
+static u1_t        _path_etx(struct blink_nbr_t *e);
+static void        _select_parent(void);
+static void        _debug_nbrs(void);
+static inline u2_t _down_vslot(u1_t hop);
+static inline u1_t _is_down_vslot(u2_t v);
+static void        _learn_route(record_t *r, u2_t via);
+static struct blink_route_t* _route_find(u2_t dest);
+static u1_t        _child_index(u2_t id);
+static u1_t        _duplicate(record_t *r);
+static void        _dup_forget(record_t *r);
 
 // job decl
 static osjob_t _root_job;
@@ -48,13 +123,41 @@ static osjob_t _sync_job;
 static osjob_t _wakeup_job;
 static osjob_t _transmit_job;
 static osjob_t _receive_job;
+static osjob_t _peek_job;
 
 // messages queues
-static beacon_msg_t beacon_tx;
-static data_msg_t   data_msg_tx;
-static data_msg_t   data_msg_rx;
-
+static beacon_t     beacon_rx;
+static record_t     record_rx;
+
+// tx ring queue of records per class
+static struct {
+  record_t   rec[TX_QUEUE_DEPTH];
+  u4_t       since[TX_QUEUE_DEPTH];  // slot count when queued
+  u1_t       head;
+  u1_t       len;
+} txq[TXQ_CLASSES];
+
+// data frame on air or awaiting retransmission
+static u1_t tx_frame[MAX_LEN_FRAME];
+static u1_t tx_len;
+static u1_t tx_tries;
+
+// (source, sequence number) of recently received records, 0 is a free entry
+// (the root never is a source)
+static u4_t dup_cache[DUP_CACHE_SIZE];
+static u1_t dup_next;
+
+// parent beacons for the drift estimator: network time and local arrival time
+static struct {
+  u4_t       net_ms;
+  ostime_t   local;
+} drift_samples[DRIFT_SAMPLES];
+static u1_t drift_len;
+static u1_t drift_next;
+
+#if (TRUE == BLINK_USE_CAD) || (TRUE == BLINK_USE_LPL)
 static u1_t cad_counter = CAD_CHECKS;
+#endif
 
 #define debug_fun() do {\
   debug_char('>'); \
@@ -98,6 +201,15 @@ void debug_opmode() {
       case OP_NODE:
          debug_char('n');
          break;
+      case OP_TXACK:
+         debug_char('A');
+         break;
+      case OP_RXACK:
+         debug_char('a');
+         break;
+      case OP_TXDOWN:
+         debug_char('W');
+         break;
        default:
          debug_char('?');
     }
@@ -110,9 +222,25 @@ void debug_opmode() {
 void blink_init(void) {
   debug_fun();
   os_clearMem((xref2u1_t)&BLINK, SIZEOFEXPR(BLINK));
-  os_clearMem((xref2u1_t)&beacon_tx, SIZEOFEXPR(beacon_msg_t));
-  os_clearMem((xref2u1_t)&data_msg_tx, SIZEOFEXPR(data_msg_t));
-  os_clearMem((xref2u1_t)&data_msg_rx, SIZEOFEXPR(data_msg_t));
+  os_clearMem((xref2u1_t)&beacon_rx, SIZEOFEXPR(beacon_rx));
+  os_clearMem((xref2u1_t)&record_rx, SIZEOFEXPR(record_t));
+  os_clearMem((xref2u1_t)&txq, SIZEOFEXPR(txq));
+  os_clearMem((xref2u1_t)&dup_cache, SIZEOFEXPR(dup_cache));
+  // keep the freshest local reading, don't let relayed traffic push out older frames
+  BLINK.txq_policy[TXQ_LOCAL]   = TXQ_DROP_OLDEST;
+  BLINK.txq_policy[TXQ_FORWARD] = TXQ_DROP_NEWEST;
+  BLINK.txq_policy[TXQ_DOWN]    = TXQ_DROP_NEWEST;
+  BLINK.period = 1;
+  BLINK.max_retries = ACK_RETRIES;
+  BLINK.cfg.slot_ms      = DEFAULT_TIME_SLOT_ms;
+  BLINK.cfg.drift_ms     = DEFAULT_MAX_DRIFT_ms;
+  BLINK.cfg.slots        = DEFAULT_TIME_SLOTS;
+  BLINK.cfg.beacon_slots = DEFAULT_BEACON_SLOTS;
+  BLINK.cfg.sched        = BLINK_SCHEDULE;
+  BLINK.cfg.ack          = BLINK_USE_ACK;
+  BLINK.cfg.down         = BLINK_USE_DOWNLINK;
+  BLINK.next.epoch = 0;
+  BLINK.next.cfg   = BLINK.cfg;
 }
 
 void blink_reset(void) {
@@ -127,6 +255,11 @@ void blink_reset(void) {
   ENZO.rps   = DEFAULT_RPS;
   ENZO.freq  = DEFAULT_FREQ;
   ENZO.txpow = DEFAULT_TXPOWER;
+  // with LPL data frames carry the long preamble
+  ENZO.rxpreamble = _data_preamble();
+
+  ASSERT(_cfg_valid(&BLINK.cfg));
+  _minislot_setup();
 
   if(BLINK.nodeid == ROOT_ID) {
     // we're special
@@ -146,61 +279,187 @@ void blink_start_sync(void) {
   ASSERT(BLINK.opmode & OP_READY);
 
   if(BLINK.opmode & OP_ROOT) {
-    // we're root, start beaconing
+    // we're root, start beaconing, our clock defines the slots
+    BLINK.parent = ROOT_ID;
+    BLINK.anchor = os_getTime();
+    BLINK.anchor_slots = BLINK.slots + 1;
     os_setCallback(&_root_job, FUNC_ADDR(_wakeup_root));
   } else {
+    // sample the channel for beacon preambles
     BLINK.opmode |= OP_SCAN;
+    BLINK.scan_start = os_getTime();
+    BLINK.scan_on = 0;
+    BLINK.scan_backoff = 0;
     os_clearCallback(&ENZO.osjob);
-    ENZO.osjob.func = FUNC_ADDR(_sync_cb);
-    os_radio(RADIO_RXON);
-    debug_led(1);
+    os_radio(RADIO_RST);
+    os_setCallback(&_sync_job, FUNC_ADDR(_scan_attempt));
   }
 }
 
-void blink_tx(u1_t *buffer, size_t n) {
+// queue a payload for the sink, returns 0 if it was dropped
+u1_t blink_tx(u1_t *buffer, size_t n) {
+  record_t r;
   debug_fun(); debug_opmode();
   ASSERT(BLINK.opmode & (OP_READY|OP_TRACK));
 
-  // TODO check if we aren't transmitting in the meantime
-  if(n > MAX_LEN_PAYLOAD) {
+  if(n > MAX_PAYLOAD_LEN) {
     // can't transmit anything that's too big
-    return;
+    return 0;
   }
-  // copy payload in data tx buffer (possibly overwriting a pending message)
-  // TODO replace with tx queue
-  os_clearMem((xref2u1_t)&data_msg_tx, SIZEOFEXPR(data_msg_t));
-  data_msg_tx.header.type = DATA;
-  data_msg_tx.header.dest = DEST_ROOT;
-  data_msg_tx.header.hop  = BLINK.hop;
-  data_msg_tx.footer.trace = (TRACE_MASK & BLINK.nodeid);
-  os_copyMem(&data_msg_tx.payload, buffer, n);
-  BLINK.pending |= PEND_DATA_TX;
+  r.hdr.len   = n;
+  r.hdr.age   = 0;
+  r.hdr.seq   = BLINK.seq++;
+  r.hdr.src   = BLINK.nodeid;
+  r.hdr.path  = 0;
+  os_copyMem(&r.payload, buffer, n);
+  return _txq_put(TXQ_LOCAL, &r);
+}
+
+// root: queue a payload for a node, routed along the path of its last uplink
+// record, returns 0 if it was dropped
+u1_t blink_tx_down(u2_t dest, u1_t *buffer, size_t n) {
+  record_t r;
+  debug_fun(); debug_opmode();
+  ASSERT(BLINK.opmode & OP_ROOT);
+
+  if(n > MAX_PAYLOAD_LEN || !BLINK.cfg.down || dest == ROOT_ID) {
+    return 0;
+  }
+  struct blink_route_t *rt = _route_find(dest);
+  for(u1_t i = 0; i < PATH_MAX && rt != NULL; i++) {
+    if((PATH_MASK & (rt->path >> (i * PATH_SHIFT))) == PATH_NOROUTE) {
+      // a relay on the way couldn't note where it came from
+      rt = NULL;
+    }
+  }
+  if(rt == NULL || (u2_t)(BLINK.epoch - rt->epoch) > ROUTE_TIMEOUT) {
+    BLINK.stats.down_noroute++;
+    return 0;
+  }
+  r.hdr.len   = n;
+  r.hdr.age   = 0;
+  r.hdr.seq   = BLINK.seq++;
+  r.hdr.src   = dest;
+  r.hdr.path  = rt->path;
+  os_copyMem(&r.payload, buffer, n);
+  return _txq_put(TXQ_DOWN, &r);
+}
+
+// root: switch the network to a new frame structure from the start of an epoch
+// returns 0 if the structure doesn't work at our data rate or the epoch is too close
+u1_t blink_set_config(const struct blink_cfg_t *cfg, u2_t epoch) {
+  ASSERT(BLINK.opmode & OP_ROOT);
+  // leave time to announce it to the deepest hop: a relay that sleeps
+  // through beacon rounds passes on what it last heard, so every hop may
+  // add a run of skipped rounds and the round it listens to again
+  if(!_cfg_valid(cfg) || (s2_t)(epoch - BLINK.epoch) < CONFIG_LEAD_EPOCHS) {
+    return 0;
+  }
+  BLINK.next.epoch = epoch;
+  BLINK.next.cfg   = *cfg;
+  return 1;
+}
+
+// shortest slot length (msec) that fits a full frame and the drift guards
+u2_t blink_slot_ms(rps_t rps, u2_t drift_ms) {
+#if (TRUE == BLINK_USE_LPL)
+  u2_t preamble = BLINK_LPL_PREAMBLE(rps);
+#else
+  u2_t preamble = STD_PREAMBLE_LEN;
+#endif
+  return osticks2ms(calcAirTimePre(rps, MAX_LEN_FRAME, preamble)) + 2 * drift_ms + 1;
+}
+
+// preamble length (symbols) of data frames with LPL: it spans the widest RX
+// window of a mini-slot, so a receiver samples it with a single CAD
+u2_t blink_lpl_preamble(rps_t rps) {
+  u4_t syms = (u4_t)(2 * MINISLOT_GUARD_ms * 1000 + calcSymTimeUs(rps) - 1) / calcSymTimeUs(rps)
+            + SCAN_CAD_SYMS;
+  return syms < STD_PREAMBLE_LEN ? STD_PREAMBLE_LEN : syms;
 }
 
-void blink_rx(u1_t *buffer, size_t n) {
+// network time (msec): time since the root started, for timestamping readings
+u4_t blink_network_time(void) {
+  ASSERT(BLINK.opmode & (OP_ROOT|OP_TRACK));
+  return BLINK.net_ms + osticks2ms(os_getTime() - BLINK.slot_time);
+}
+
+// set the reporting period in epochs
+void blink_set_period(u1_t epochs) {
+  ASSERT(epochs > 0 && epochs <= MAX_PERIOD);
+  BLINK.period = epochs;
+}
+
+// start of our next source mini-slot that honours the reporting period
+ostime_t blink_next_report(void) {
+  u2_t v = _source_vslot();
+  u1_t slot = BEACON_SLOTS + v / BLINK.minislots;
+  u1_t slots = (slot + TIME_SLOTS - BLINK.slot) % TIME_SLOTS;
+  if(slots == 0) {
+    // we're in it, the next one is an epoch away
+    slots = TIME_SLOTS;
+  }
+  return BLINK.slot_time + (slots + (BLINK.period - 1) * TIME_SLOTS) * TIME_SLOT_ticks
+       + SLOT_GUARD_ticks + (v % BLINK.minislots) * BLINK.minislot_ticks;
+}
+
+// number of frames waiting in a tx queue class
+u1_t blink_txq_len(u1_t cls) {
+  ASSERT(cls < TXQ_CLASSES);
+  return txq[cls].len;
+}
+
+// copy the received payload, returns the number of bytes copied
+size_t blink_rx(u1_t *buffer, size_t n) {
   debug_fun(); debug_opmode();
-  // copy at most max len payload
-  n = n > MAX_LEN_PAYLOAD ? MAX_LEN_PAYLOAD : n;
-  os_copyMem(buffer, &data_msg_rx.payload, n);
+  // copy at most the received payload
+  n = n > record_rx.hdr.len ? record_rx.hdr.len : n;
+  os_copyMem(buffer, &record_rx.payload, n);
   BLINK.pending &= ~(PEND_DATA_RX);
+  return n;
 }
 
 static void _sync_cb(osjob_t *job) {
   debug_fun(); debug_opmode();
+  BLINK.scan_on += os_getTime() - BLINK.rx_time;
   // lets assume we got a beacon
-  beacon_msg_t *b = (beacon_msg_t*)ENZO.frame;
-  if(ENZO.dataLen == SIZEOFEXPR(beacon_msg_t) && b->header.type == BEACON) {
+  beacon_t *b = &beacon_rx;
+  if(ENZO.crcerr == 0 && _frame_valid(BEACON)) {
     // got a beacon!
     BLINK.missed_beacons = 0;
-    // we are hop + 1 away from the sink
-    BLINK.hop = b->header.hop + 1;
+    // attach through the sender until we know our neighbours better
+    // (start from an empty table, so there's room for it)
+    os_clearMem((xref2u1_t)&BLINK.nbr, SIZEOFEXPR(BLINK.nbr));
+    struct blink_nbr_t *n = _nbr_update(b);
+    BLINK.hop = n->hop + 1;
+    BLINK.parent = n->id;
+    BLINK.etx = _path_etx(n);
     // sink starts the beacon in slot 0, so hop count is equal to current (beacon) slot
     BLINK.slot = b->header.hop;
+    _beacon_config(b);
+    // beacon was sent one guard time into the slot
+    BLINK.beacon_time = _rx_start_time();
+    BLINK.slot_time = BLINK.beacon_time - SLOT_GUARD_ticks;
+    BLINK.net_ms = b->time - BLINK.cfg.drift_ms;
+    BLINK.sync_err = 0;
+    _drift_sample(b->time, BLINK.beacon_time);
     // set our next wakeup slot
-    os_setTimedCallback(&_wakeup_job, ENZO.rxtime + TIME_SLOT_ticks - AIRTIME_BEACON_ticks, FUNC_ADDR(_wakeup));
+    _anchor(BLINK.slot_time);
     // update our opmode
     BLINK.opmode &= ~(OP_SCAN);
     BLINK.opmode |= OP_TRACK;
+    os_clearCallback(&_sync_job);
+    // time and energy it took
+    ostime_t t = os_getTime() - BLINK.scan_start;
+    BLINK.stats.scan_syncs++;
+    BLINK.stats.scan_ticks += t;
+    BLINK.stats.scan_on_ticks += BLINK.scan_on;
+    if(t > BLINK.stats.scan_ticks_max) {
+      BLINK.stats.scan_ticks_max = t;
+    }
+    if(BLINK.scan_on > BLINK.stats.scan_on_max) {
+      BLINK.stats.scan_on_max = BLINK.scan_on;
+    }
     // rebroadcast the beacon (if possible)
     _rebroadcast_beacon(b);
     // tell the upper layers
@@ -208,67 +467,158 @@ static void _sync_cb(osjob_t *job) {
     debug_led(0);
   } else {
     debug_char('.');
-    // doesn't seem to be a beacon, keep listening
-    os_radio(RADIO_RXON);
+    // doesn't seem to be a beacon, keep sampling
+    _scan_resume();
   }
 }
 
-static void _wakeup(osjob_t *job) {
+// start a scan attempt: sample the channel for one epoch, long enough to
+// hear a beacon round of any neighbour in range
+static void _scan_attempt(osjob_t *job) {
+  debug_fun(); debug_opmode();
+  BLINK.scan_end = os_getTime() + TIME_SLOTS * TIME_SLOT_ticks;
+  _scan_cad(job);
+}
+
+// sample the channel, or back off once the attempt is over
+static void _scan_cad(osjob_t *job) {
   ostime_t now = os_getTime();
+  if(now - BLINK.scan_end >= 0) {
+    // nothing heard, sleep for twice as many epochs as last time
+    if(BLINK.scan_backoff < SCAN_BACKOFF_MAX) {
+      BLINK.scan_backoff++;
+    }
+    s8_t sleep = (s8_t)TIME_SLOTS * TIME_SLOT_ticks << BLINK.scan_backoff;
+    if(sleep > sec2osticks(SCAN_SLEEP_MAX_s)) {
+      sleep = sec2osticks(SCAN_SLEEP_MAX_s);
+    }
+    debug_led(0);
+    os_setTimedCallback(&_sync_job, now + (ostime_t)sleep, FUNC_ADDR(_scan_attempt));
+    return;
+  }
+  debug_led(1);
+  BLINK.rx_time = now;
+  BLINK.stats.scan_cads++;
+  _set_radio_callback(FUNC_ADDR(_scan_cad_done));
+  os_radio(RADIO_CAD);
+}
+
+static void _scan_cad_done(osjob_t *job) {
+  BLINK.scan_on += ENZO.rxtime - BLINK.rx_time;
+  if(ENZO.cad) {
+    // preamble on air, receive the frame
+    _set_radio_callback(FUNC_ADDR(_sync_cb));
+    BLINK.rx_time = os_getTime();
+    ENZO.rxsyms = STD_PREAMBLE_LEN + RX_MIN_SYMS;
+    ENZO.rxtime = 0; // start now
+    os_radio(RADIO_RX);
+  } else {
+    debug_led(0);
+    _scan_resume();
+  }
+}
+
+// sample again in time to catch a preamble that started after the last CAD
+static void _scan_resume(void) {
+  os_setTimedCallback(&_sync_job, BLINK.rx_time + _scan_interval(), FUNC_ADDR(_scan_cad));
+}
+
+// preamble length (symbols) of data and downlink frames
+static u2_t _data_preamble(void) {
+#if (TRUE == BLINK_USE_LPL)
+  return BLINK_LPL_PREAMBLE(ENZO.rps);
+#else
+  return STD_PREAMBLE_LEN;
+#endif
+}
+
+// check the header of a data frame being received every few symbols from t
+static void _peek_start(ostime_t t) {
+#if (TRUE == BLINK_USE_RX_PEEK)
+  os_setTimedCallback(&_peek_job, t + us2osticks(RX_PEEK_SYMS * calcSymTimeUs(ENZO.rps)), FUNC_ADDR(_rx_peek));
+#endif
+}
+
+// receiver on-time spent on a data mini-slot nobody sent in
+static void _idle_stats(void) {
+  BLINK.stats.data_idle_slots++;
+  BLINK.stats.data_idle_ticks += os_getTime() - BLINK.rx_time;
+}
+
+// CAD period that can't miss a preamble: one CAD falls entirely within it
+// and leaves enough of it to switch from CAD to RX before the sync word
+static ostime_t _scan_interval(void) {
+  u4_t sym = calcSymTimeUs(ENZO.rps);
+  u2_t margin = (SCAN_SWITCH_us + sym - 1) / sym;
+  s2_t n = STD_PREAMBLE_LEN - SCAN_CAD_SYMS - margin;
+  if(n < 1) {
+    n = 1; // back-to-back CADs
+  }
+  return us2osticks(n * sym);
+}
+
+static void _wakeup(osjob_t *job) {
   debug_led(1);
   debug_fun(); debug_opmode();
   ASSERT(BLINK.opmode & OP_READY);
 
   // increment slot
   _next_slot();
+  BLINK.slot_time = job->deadline;
 
   if(_is_beacon_slot()) {
     /* beacon slot */
+    if(BLINK.bcn_skip && BLINK.slot == BLINK.hop) {
+      // sleeping through this round, send our beacon off our own clock
+      BLINK.pending |= PEND_BEACON_TX;
+    }
     if(BLINK.pending & PEND_BEACON_TX) {
       // retransmit beacon
-      os_setCallback(&_transmit_job, FUNC_ADDR(_beacon_tx));
+      os_setTimedCallback(&_transmit_job, BLINK.slot_time + SLOT_GUARD_ticks, FUNC_ADDR(_beacon_tx));
+    } else if(BLINK.bcn_skip) {
+      // our clock is good enough, don't listen
     } else {
-      if(BLINK.slot == 0) {
-        // we accept any hop
-        BLINK.hop_updated = 0;
-      }
       // look for beacon
-      os_setCallback(&_receive_job, FUNC_ADDR(_beacon_rx));
+      _schedule_rx(BLINK.slot_time + SLOT_GUARD_ticks, FUNC_ADDR(_beacon_rx));
     }
   } else if(_is_data_slot()) {
     /* data slot */
-    if(BLINK.pending & PEND_DATA_TX) {
-      // transmit
-      os_setCallback(&_transmit_job, FUNC_ADDR(_data_tx));
-    } else {
-      // listen
-      os_setCallback(&_receive_job, FUNC_ADDR(_data_rx));
+    if(BLINK.slot == BEACON_SLOTS) {
+      // beacons are done for this epoch, pick the parent for its data slots
+      if(BLINK.bcn_skip) {
+        // (nothing heard, nothing to learn)
+        BLINK.bcn_skip--;
+        BLINK.stats.bcn_skipped++;
+      } else {
+        _bcn_adapt();
+        _nbr_epoch();
+      }
+      _select_parent();
     }
+    BLINK.minislot = 0;
+    _schedule_minislot();
   } else {
     // TODO no beacon or data slot, err?
 	  ASSERT(0);
   }
 
-  // schedule next wakeup
-  os_setTimedCallback(&_wakeup_job, now + TIME_SLOT_ticks, FUNC_ADDR(_wakeup));
+  // schedule next wakeup, from the slot grid rather than now (which runs late)
+  os_setTimedCallback(&_wakeup_job, _slot_start(BLINK.slots + 1), FUNC_ADDR(_wakeup));
 }
 
 static void _wakeup_root(osjob_t *job) {
-  ostime_t now = os_getTime();
   debug_led(1);
   debug_fun(); debug_opmode();
   // increment slot
   _next_slot();
+  BLINK.slot_time = _slot_start(BLINK.slots);
   if(_is_beacon_slot()) {
     if(BLINK.slot == 0) {
-      beacon_tx.header.type = BEACON;
-      beacon_tx.header.hop  = 0;
-      beacon_tx.header.dest = DEST_BROADCAST;
       // radio may be in RXON mode, set in SLEEP mode before we can do anything
       // and clear any pending callbacks
       os_clearCallback(&ENZO.osjob);
       os_radio(RADIO_RST);
-      os_setCallback(&_transmit_job, FUNC_ADDR(_beacon_tx));
+      os_setTimedCallback(&_transmit_job, BLINK.slot_time + SLOT_GUARD_ticks, FUNC_ADDR(_beacon_tx));
     } else {
       BLINK.opmode |= (OP_RXBCN);
       os_clearCallback(&ENZO.osjob);
@@ -286,9 +636,14 @@ static void _wakeup_root(osjob_t *job) {
       BLINK.opmode |= OP_RXDATA;
       // we're already listening
     }
+    // our downlink mini-slot may fall in this slot
+    u2_t v = _down_vslot(0);
+    if(BLINK.cfg.down && txq[TXQ_DOWN].len > 0 && v >= _vslot(0) && v < _vslot(0) + BLINK.minislots) {
+      os_setTimedCallback(&_transmit_job, _minislot_time(v - _vslot(0)), FUNC_ADDR(_down_tx));
+    }
     debug_led(0);
   }
-  os_setTimedCallback(&_root_job, now + TIME_SLOT_ticks, _wakeup_root);
+  os_setTimedCallback(&_root_job, _slot_start(BLINK.slots + 1), _wakeup_root);
 }
 
 static void _beacon_tx(osjob_t *job) {
@@ -297,9 +652,26 @@ static void _beacon_tx(osjob_t *job) {
           ((BLINK.opmode & OP_NODE) && (BLINK.opmode & (OP_READY|OP_TRACK))) ||
             0);
 
-  // prepare packet for transmit
-  os_copyMem(ENZO.frame, &beacon_tx, SIZEOFEXPR(beacon_msg_t));
-  ENZO.dataLen = SIZEOFEXPR(beacon_msg_t);
+  // prepare packet for transmit, we send in the beacon slot of our hop
+  header_t *h = (header_t*)ENZO.frame;
+  h->type   = BEACON;
+  h->ackreq = 0;
+  h->hop    = BLINK.slot;
+  h->dest   = DEST_BROADCAST;
+  h->src    = BLINK.nodeid;
+  u1_t len = SIZEOFEXPR(header_t);
+  u4_t time = BLINK.net_ms + BLINK.cfg.drift_ms;
+  u2_t digest = _cfg_digest(&BLINK.cfg);
+  len = _tlv_put(len, BCN_EPOCH, &BLINK.epoch, SIZEOFEXPR(BLINK.epoch));
+  len = _tlv_put(len, BCN_TIME, &time, SIZEOFEXPR(time));
+  len = _tlv_put(len, BCN_ETX, &BLINK.etx, SIZEOFEXPR(BLINK.etx));
+  len = _tlv_put(len, BCN_DIGEST, &digest, SIZEOFEXPR(digest));
+  if(digest != _cfg_digest(&BLINK.next.cfg) || BLINK.epoch % BCN_CONFIG_EVERY == 0) {
+    // a switch is coming, or repeat the structure for late joiners
+    len = _tlv_put(len, BCN_CONFIG, &BLINK.next, SIZEOFEXPR(BLINK.next));
+  }
+  ENZO.dataLen = len;
+  ENZO.preamble = STD_PREAMBLE_LEN;
 
   // set up tx callback
   ENZO.osjob.func = FUNC_ADDR(_tx_done);
@@ -324,8 +696,8 @@ static void _beacon_rx(osjob_t *job) {
 #else /* TRUE == BLINK_USE_CAD */
   os_clearCallback(&ENZO.osjob);
   ENZO.osjob.func = FUNC_ADDR(_rx_done);
-  ENZO.rxsyms = 50; // TODO less symbols is probably also sufficient?
-  ENZO.rxtime = 0; // start now
+  ENZO.rxsyms = BLINK.rx_syms;
+  ENZO.rxtime = BLINK.rx_time;
   os_radio(RADIO_RX);
 #endif
 }
@@ -334,9 +706,42 @@ static void _data_tx(osjob_t *job) {
   debug_fun(); debug_opmode();
   ASSERT(BLINK.opmode & (OP_READY|OP_TRACK));
 
+  if(tx_len == 0) {
+    // pack as many queued records as fit in one frame
+    tx_len = SIZEOFEXPR(header_t);
+    tx_tries = 0;
+    BLINK.tx_local = 0;
+    record_t *r;
+    u1_t cls;
+    while((r = _txq_peek(_tx_classes(), &cls)) != NULL &&
+          tx_len + _record_size(r, BLINK.nodeid) <= MAX_LEN_FRAME) {
+      // add the slots it waited in our queue
+      u4_t age = r->hdr.age + (BLINK.slots - txq[cls].since[txq[cls].head]);
+      r->hdr.age = age > 0xFF ? 0xFF : age;
+      tx_len += _record_pack(tx_frame + tx_len, r, BLINK.nodeid);
+      BLINK.stats.tx_records++;
+      BLINK.stats.tx_bytes += r->hdr.len;
+      if(cls == TXQ_LOCAL) {
+        BLINK.tx_local++;
+      }
+      _txq_pop(cls);
+    }
+    BLINK.stats.tx_frames++;
+  }
+  // (re)address to our current parent
+  data_msg_t *d = (data_msg_t*)tx_frame;
+  d->header.type   = DATA;
+  d->header.ackreq = BLINK.cfg.ack;
+  d->header.hop    = BLINK.hop;
+  d->header.dest   = BLINK.parent;
+  d->header.src    = BLINK.nodeid;
+
   // prepare packet for transmit
-  os_copyMem(ENZO.frame, &data_msg_tx, SIZEOFEXPR(data_msg_t));
-  ENZO.dataLen = SIZEOFEXPR(data_msg_t);
+  os_copyMem(ENZO.frame, tx_frame, tx_len);
+  ENZO.dataLen = tx_len;
+  ENZO.preamble = _data_preamble();
+  tx_tries++;
+  BLINK.stats.tx_ticks += calcAirTimePre(ENZO.rps, ENZO.dataLen, ENZO.preamble);
 
   // set opmode
   BLINK.opmode |= OP_TXDATA;
@@ -355,17 +760,25 @@ static void _data_rx(osjob_t *job) {
   // set opmode
   BLINK.opmode |= OP_RXDATA;
 
-#if (TRUE == BLINK_USE_CAD)
+#if (TRUE == BLINK_USE_LPL)
+  // the sender's long preamble is on air by now if there's a frame,
+  // a single CAD tells
+  cad_counter = 0;
+  _set_radio_callback(FUNC_ADDR(_cad_done));
+  os_radio(RADIO_CAD);
+#elif (TRUE == BLINK_USE_CAD)
   ENZO.osjob.func = FUNC_ADDR(_cad_done);
   os_radio(RADIO_CAD);
 #else /* TRUE == BLINK_USE_CAD */
   ENZO.osjob.func = FUNC_ADDR(_rx_done);
-  ENZO.rxsyms = 50; // TODO less symbols is probably also sufficient?
-  ENZO.rxtime = 0; // start now
+  ENZO.rxsyms = BLINK.rx_syms;
+  ENZO.rxtime = BLINK.rx_time;
   os_radio(RADIO_RX);
+  _peek_start(BLINK.rx_time);
 #endif
 }
 
+#if (TRUE == BLINK_USE_CAD) || (TRUE == BLINK_USE_LPL)
 static void _cad_done(osjob_t *job) {
   debug_fun(); debug_opmode();
   if(ENZO.cad) {
@@ -375,16 +788,16 @@ static void _cad_done(osjob_t *job) {
 
     // set up rx done callback
     ENZO.osjob.func = FUNC_ADDR(_rx_done);
-    // TODO symbols?
-    // ENZO.rxsyms = 20;
+    ENZO.rxsyms = BLINK.rx_syms;
+    cad_counter = CAD_CHECKS;
     // start single rx
     ENZO.rxtime = 0; // start now
     os_radio(RADIO_RX);
+    if(BLINK.opmode & OP_RXDATA) {
+      _peek_start(os_getTime());
+    }
   } else {
-    if(BLINK.opmode & OP_SCAN) {
-      // we're scanning for beacons, don't care about time outs
-      os_radio(RADIO_CAD);
-    } else if(cad_counter > 0) {
+    if(cad_counter > 0) {
       // retry
       cad_counter--;
       os_radio(RADIO_CAD);
@@ -396,25 +809,37 @@ static void _cad_done(osjob_t *job) {
       } else if (BLINK.opmode & OP_RXDATA) {
         // nothing useful in this data time slot
         BLINK.opmode &= ~(OP_RXDATA);
+        _idle_stats();
+        _next_minislot();
       }
       // reset cad counter
       cad_counter = CAD_CHECKS;
+      _rx_stats();
       debug_led(0);
     }
   }
 }
+#endif /* TRUE == BLINK_USE_CAD || TRUE == BLINK_USE_LPL */
 
 static void _rx_done(osjob_t *job) {
+  u1_t rxdata = BLINK.opmode & OP_RXDATA;
   debug_fun(); debug_opmode();
+  os_clearCallback(&_peek_job);
+  _rx_stats();
 
   if(ENZO.dataLen == 0 || ENZO.crcerr == 1) {
     if(ENZO.crcerr == 1) {
       debug("garbage");
+      if(BLINK.opmode & OP_RXDATA) {
+        BLINK.stats.rx_collisions++;
+      }
     }
     // nothing received, or received garbage
     if(BLINK.opmode & OP_RXBCN) {
       // we were expecting a beacon, and we missed it
       _missed_beacon();
+    } else if(rxdata && ENZO.crcerr == 0) {
+      _idle_stats();
     }
   } else if(BLINK.opmode & OP_RXBCN) {
     debug("beacon");
@@ -427,6 +852,11 @@ static void _rx_done(osjob_t *job) {
     ASSERT(0);
   }
 
+  if(rxdata && (BLINK.pending & PEND_ACK_TX) == 0) {
+    // (otherwise we carry on once the ACK is out)
+    _rx_continue(ENZO.dataLen != 0 && ENZO.crcerr == 0 && _frame_valid(DATA));
+  }
+
   // clear modes
   BLINK.opmode &= ~(OP_RXBCN|OP_RXDATA);
   debug_led(0);
@@ -437,18 +867,11 @@ static void _rx_beacon_done(osjob_t *job) {
   ASSERT(BLINK.opmode & OP_RXBCN);
 
   // did we receive a beacon?
-  beacon_msg_t *b = (beacon_msg_t*)ENZO.frame;
-  if(ENZO.dataLen == SIZEOFEXPR(beacon_msg_t) && b->header.type == BEACON) {
-    if(BLINK.hop_updated == 0) {
-      debug_str("hop ");
-      debug_hex(BLINK.hop);
-      BLINK.hop = b->header.hop + 1;
-      BLINK.hop_updated = 1;
-      debug_str(" -> ");
-      debug_hex(BLINK.hop);
-      debug_char('\r');
-      debug_char('\n');
-    }
+  beacon_t *b = &beacon_rx;
+  if(_frame_valid(BEACON)) {
+    // track the link to the sender, the parent is picked after the beacon slots
+    _nbr_update(b);
+    u1_t expected = b->header.hop == BLINK.slot;
     // update our slot
     if( b->header.hop != BLINK.slot ) {
       debug_str("slot ");
@@ -459,15 +882,37 @@ static void _rx_beacon_done(osjob_t *job) {
       debug_char('\n');
       BLINK.slot = b->header.hop;
     }
-    if(abs(_wakeup_job.deadline - (ENZO.rxtime - AIRTIME_BEACON_ticks)) > ms2osticks(MAX_DRIFT_ms)) {
-      // reschedule wake slot based on the beacon time as we've drifed too much
-      os_setTimedCallback(&_wakeup_job, ENZO.rxtime + TIME_SLOT_ticks - AIRTIME_BEACON_ticks, FUNC_ADDR(_wakeup));
+    _beacon_config(b);
+    // only our parent's clock is ours to follow, other nodes may send
+    // their beacons off their own drifting clock (when skipping rounds)
+    if(b->header.src == BLINK.parent) {
+      // measure how far off the beacon was from where we expected it
+      BLINK.beacon_time = _rx_start_time();
+      BLINK.sync_err = abs(BLINK.beacon_time - (BLINK.slot_time + SLOT_GUARD_ticks));
+      if(expected) {
+        BLINK.stats.sync_beacons++;
+        BLINK.stats.sync_err_sum += BLINK.sync_err;
+        if(BLINK.sync_err > BLINK.stats.sync_err_max) {
+          BLINK.stats.sync_err_max = BLINK.sync_err;
+        }
+      }
+      if(BLINK.sync_err > SLOT_GUARD_ticks) {
+        // beacon outside this slot's window (e.g. heard in a data slot)
+        BLINK.sync_err = SLOT_GUARD_ticks;
+      }
+      // take the network time of the sender
+      BLINK.net_ms = b->time - osticks2ms(BLINK.beacon_time - BLINK.slot_time);
+      _drift_sample(b->time, BLINK.beacon_time);
+      // re-anchor the slot grid on the beacon time
+      _anchor(BLINK.beacon_time - SLOT_GUARD_ticks);
     }
     // reset missed beacons
     BLINK.missed_beacons = 0;
 
-    // rebroadcast the beacon (if possible)
-    _rebroadcast_beacon(b);
+    // rebroadcast our parent's beacon (if possible), in the slot of our hop
+    if(b->header.src == BLINK.parent) {
+      _rebroadcast_beacon(b);
+    }
   } else {
     // expected beacon, got something else, count as a missed beacon
     _missed_beacon();
@@ -482,29 +927,43 @@ static void _rx_data_done(osjob_t *job) {
 
   // check if we actually received something data-like
   data_msg_t *d = (data_msg_t*)ENZO.frame;
-  if(ENZO.dataLen == SIZEOFEXPR(data_msg_t) && d->header.type == DATA) {
-    if(d->header.dest == BLINK.nodeid) {
-      // it's for us, notify the upper layer
-      os_copyMem(&data_msg_rx, ENZO.frame, SIZEOFEXPR(data_msg_t));
-      BLINK.pending |= PEND_DATA_RX;
-      _report_event(EVENT_RXCOMPLETE);
-    } else {
-      // not for us, check if we can rebroadcast it to bring it closer to the sink
-      // XXX for now just add the message to the transmit buffer, overwriting any
-	  // pending message and falsley trigger the upper layer with EV_TXCOMPLETE
-		if(d->header.hop > BLINK.hop) {
-        os_copyMem(&data_msg_tx, ENZO.frame, SIZEOFEXPR(data_msg_t));
-        data_msg_tx.header.hop--;
-        // add our node id to the trace if there's room
-        if(data_msg_tx.header.hop < TRACE_MAX) {
-          data_msg_tx.footer.trace |= ((TRACE_MASK & BLINK.nodeid) << (TRACE_SHIFT * data_msg_tx.header.hop));
+  if(_frame_valid(DATA)) {
+    if(d->header.src != BLINK.nodeid && _vslot(BLINK.minislot) == _source_vslot()) {
+      // another node owns our mini-slot too, pick another one
+      BLINK.stats.slot_shared++;
+      BLINK.vslot_salt++;
+    }
+    u1_t off = SIZEOFEXPR(header_t);
+    u1_t queued = 1;
+    while(off < ENZO.dataLen) {
+      record_t rec, *r = &rec;
+      off += _record_unpack(off, r);
+      if(d->header.dest == BLINK.nodeid && _duplicate(r)) {
+        // already forwarded it
+        BLINK.stats.rx_duplicates++;
+      } else if(d->header.dest == BLINK.nodeid) {
+        // we're the sender's parent, bring it closer to the sink
+        // note which child it came from, so the root can route back
+        if(BLINK.hop >= 1 && BLINK.hop <= PATH_MAX) {
+          r->hdr.path |= (u2_t)_child_index(d->header.src) << (PATH_SHIFT * (BLINK.hop - 1));
+        }
+        if(!_txq_put(TXQ_FORWARD, r)) {
+          // no room, take it when the sender tries again
+          _dup_forget(r);
+          queued = 0;
         }
-        BLINK.pending |= PEND_DATA_TX;
       }
     }
+    if(d->header.dest == BLINK.nodeid && d->header.ackreq && queued) {
+      // acknowledge right after the frame (only once we hold all of it)
+      BLINK.pending |= PEND_ACK_TX;
+      os_setTimedCallback(&_transmit_job, ENZO.rxtime + ms2osticks(ACK_DELAY_ms), FUNC_ADDR(_ack_tx));
+    }
+  } else if(_frame_valid(DOWN)) {
+    _rx_down_done(job);
   } else {
     // expected data, got someting else, may be a beacon?
-    if(ENZO.dataLen == SIZEOFEXPR(beacon_msg_t) && d->header.type == BEACON) {
+    if(_frame_valid(BEACON)) {
       debug_str("beacon in data slot\r\n");
       // process as beacon
       BLINK.opmode |= OP_RXBCN;
@@ -518,6 +977,13 @@ static void _rx_data_done(osjob_t *job) {
 static void _rx_root_done(osjob_t *job) {
   debug_fun(); debug_opmode();
 
+  if(ENZO.crcerr == 1) {
+    debug("garbage");
+    BLINK.stats.rx_collisions++;
+    os_radio(RADIO_RXON);
+    return;
+  }
+
   header_t *h = (header_t*)ENZO.frame;
   switch(h->type) {
     case BEACON:
@@ -532,25 +998,224 @@ static void _rx_root_done(osjob_t *job) {
   }
   debug_buf(ENZO.frame, ENZO.dataLen);
 
-  if(h->type == DATA) {
+  if(_frame_valid(DATA) && h->dest == ROOT_ID) {
       data_msg_t *d = (data_msg_t*)ENZO.frame;
       debug_str("hop ");
       debug_hex(d->header.hop); debug_char('\r'); debug_char('\n');
-      debug_str("dest ");
-      debug_hex(d->header.dest); debug_char('\r'); debug_char('\n');
-      debug_str("trace ");
-      for(u1_t i = 0; i < TRACE_MAX; i++) {
-        debug_hex(i);
-        debug_char(':');
-        debug_hex(TRACE_MASK & (d->footer.trace >> (i * TRACE_SHIFT)));
-        debug_char(' ');
+      debug_str("from ");
+      debug_uint(d->header.src); debug_char('\r'); debug_char('\n');
+      // unpack the records
+      u1_t off = SIZEOFEXPR(header_t);
+      while(off < ENZO.dataLen) {
+        record_t rec, *r = &rec;
+        off += _record_unpack(off, r);
+        if(_duplicate(r)) {
+          // already delivered it
+          BLINK.stats.rx_duplicates++;
+          continue;
+        }
+        debug_str("src ");
+        debug_uint(r->hdr.src);
+        debug_str(" path ");
+        for(u1_t i = 0; i < PATH_MAX; i++) {
+          debug_hex(i + 1);
+          debug_char(':');
+          debug_hex(PATH_MASK & (r->hdr.path >> (i * PATH_SHIFT)));
+          debug_char(' ');
+        }
+        debug_char('\r'); debug_char('\n');
+        debug_buf(r->payload, r->hdr.len);
+        _learn_route(r, d->header.src);
+        _latency_stats(r);
+        BLINK.stats.rx_records++;
+        BLINK.stats.rx_bytes += r->hdr.len;
+      }
+      BLINK.stats.rx_frames++;
+      BLINK.stats.rx_ticks += calcAirTimePre(ENZO.rps, ENZO.dataLen, _data_preamble());
+      if(d->header.ackreq) {
+        // acknowledge right after the frame, then keep listening
+        BLINK.pending |= PEND_ACK_TX;
+        os_setTimedCallback(&_transmit_job, ENZO.rxtime + ms2osticks(ACK_DELAY_ms), FUNC_ADDR(_ack_tx));
+        return;
       }
-      debug_char('\r'); debug_char('\n');
   }
   // keep listening
   os_radio(RADIO_RXON);
 }
 
+#if (TRUE == BLINK_USE_RX_PEEK)
+// look at the header of the data frame being received, and stop receiving
+// it if it's not for us (no DIO carries ValidHeader, so poll for it)
+static void _rx_peek(osjob_t *job) {
+  if(!(BLINK.opmode & OP_RXDATA)) {
+    return;
+  }
+  if(!radio_rx_peek(SIZEOFEXPR(header_t))) {
+    // header not in yet
+    _peek_start(os_getTime());
+    return;
+  }
+  header_t *h = (header_t*)ENZO.frame;
+  if(h->type == BEACON || h->dest == BLINK.nodeid) {
+    // receive it in full
+    return;
+  }
+  if(h->type == DATA && h->src != BLINK.nodeid && _vslot(BLINK.minislot) == _source_vslot()) {
+    // another node owns our mini-slot too (as in _rx_data_done)
+    BLINK.stats.slot_shared++;
+    BLINK.vslot_salt++;
+  }
+  debug_str("abort rx\r\n");
+  os_radio(RADIO_RST);
+  os_clearCallback(&ENZO.osjob);
+  BLINK.stats.rx_aborted++;
+  _rx_stats();
+  // the rest of this mini-slot is the same sender's
+  BLINK.opmode &= ~(OP_RXDATA);
+  _next_minislot();
+  debug_led(0);
+}
+#endif /* TRUE == BLINK_USE_RX_PEEK */
+
+static void _rx_down_done(osjob_t *job) {
+  debug_fun(); debug_opmode();
+  data_msg_t *d = (data_msg_t*)ENZO.frame;
+  if(d->header.dest != BLINK.nodeid) {
+    // not on its route
+    return;
+  }
+  record_t rec, *r = &rec;
+  _record_unpack(SIZEOFEXPR(header_t), r);
+  if(r->hdr.src == BLINK.nodeid) {
+    // we're the destination, hand it to the upper layer
+    os_copyMem(&record_rx, r, SIZEOFEXPR(record_hdr_t) + r->hdr.len);
+    BLINK.stats.down_rx++;
+    BLINK.stats.down_age += r->hdr.age;
+    if(r->hdr.age > BLINK.stats.down_age_max) {
+      BLINK.stats.down_age_max = r->hdr.age;
+    }
+    BLINK.pending |= PEND_DATA_RX;
+    _report_event(EVENT_RXCOMPLETE);
+  } else if(_txq_put(TXQ_DOWN, r)) {
+    // pass it on in our downlink mini-slot
+    BLINK.stats.down_fwd++;
+  }
+}
+
+// send the next downlink record one hop further along its route
+static void _down_tx(osjob_t *job) {
+  debug_fun(); debug_opmode();
+  record_t *r = _txq_peek(1 << TXQ_DOWN, NULL);
+  ASSERT(r != NULL);
+
+  if(BLINK.opmode & OP_ROOT) {
+    // radio is in RXON mode, stop it first
+    os_clearCallback(&ENZO.osjob);
+    os_radio(RADIO_RST);
+  }
+  data_msg_t *d = (data_msg_t*)ENZO.frame;
+  // add the slots it waited in our queue
+  u4_t age = r->hdr.age + (BLINK.slots - txq[TXQ_DOWN].since[txq[TXQ_DOWN].head]);
+  r->hdr.age = age > 0xFF ? 0xFF : age;
+  ENZO.dataLen = SIZEOFEXPR(header_t) + _record_pack(d->records, r, BLINK.nodeid);
+
+  // next hop: the root's first hop on the route, or the child we noted in the path
+  u2_t next = ROOT_ID;
+  if(BLINK.opmode & OP_ROOT) {
+    struct blink_route_t *rt = _route_find(r->hdr.src);
+    if(rt != NULL) {
+      next = rt->via;
+      rt->sent++;
+    }
+  } else if(BLINK.hop >= 1 && BLINK.hop <= PATH_MAX) {
+    u1_t idx = PATH_MASK & (r->hdr.path >> (PATH_SHIFT * (BLINK.hop - 1)));
+    if(idx > 0 && idx <= CHILD_TABLE_SIZE) {
+      next = BLINK.children[idx - 1];
+    }
+  }
+  _txq_pop(TXQ_DOWN);
+  if(next == ROOT_ID) {
+    // lost the way, drop it
+    debug("no route");
+    if(BLINK.opmode & OP_ROOT) {
+      _set_radio_callback(FUNC_ADDR(_rx_root_done));
+      os_radio(RADIO_RXON);
+    } else {
+      _next_minislot();
+    }
+    return;
+  }
+  d->header.type   = DOWN;
+  d->header.ackreq = 0;
+  d->header.hop    = BLINK.hop;
+  d->header.dest   = next;
+  d->header.src    = BLINK.nodeid;
+  ENZO.preamble = _data_preamble();
+
+  BLINK.opmode |= OP_TXDOWN;
+  _set_radio_callback(FUNC_ADDR(_tx_done));
+  os_radio(RADIO_TX);
+}
+
+static void _ack_tx(osjob_t *job) {
+  debug_fun(); debug_opmode();
+  // the data frame is still in the radio buffer
+  header_t *h = (header_t*)ENZO.frame;
+  u2_t dest = h->src;
+  h->type   = ACK;
+  h->ackreq = 0;
+  h->hop    = BLINK.hop;
+  h->dest   = dest;
+  h->src    = BLINK.nodeid;
+  ENZO.dataLen = SIZEOFEXPR(header_t);
+  ENZO.preamble = STD_PREAMBLE_LEN;
+
+  BLINK.pending &= ~(PEND_ACK_TX);
+  BLINK.opmode |= OP_TXACK;
+  _set_radio_callback(FUNC_ADDR(_tx_done));
+  os_radio(RADIO_TX);
+}
+
+static void _ack_rx(osjob_t *job) {
+  debug_fun(); debug_opmode();
+  BLINK.opmode |= OP_RXACK;
+  _set_radio_callback(FUNC_ADDR(_ack_done));
+  ENZO.rxsyms = BLINK.rx_syms;
+  ENZO.rxtime = BLINK.rx_time;
+  os_radio(RADIO_RX);
+}
+
+static void _ack_done(osjob_t *job) {
+  debug_fun(); debug_opmode();
+  _rx_stats();
+  BLINK.opmode &= ~(OP_RXACK);
+
+  header_t *h = (header_t*)ENZO.frame;
+  data_msg_t *d = (data_msg_t*)tx_frame;
+  if(ENZO.dataLen != 0 && ENZO.crcerr == 0 && _frame_valid(ACK) &&
+     h->dest == BLINK.nodeid && h->src == d->header.dest) {
+    debug("ack");
+    struct blink_nbr_t *n = _nbr_find(d->header.dest);
+    if(n != NULL) {
+      n->link_ack++;
+    }
+    _tx_finish(1);
+  } else if(tx_tries > BLINK.max_retries) {
+    debug("no ack, giving up");
+    BLINK.stats.tx_failed++;
+    // (it may have collided with a node that owns our mini-slot too, which
+    // we can't hear while we send, pick another one)
+    BLINK.vslot_salt++;
+    _tx_finish(0);
+  } else {
+    debug("no ack");
+    // keep the frame for a retry
+    BLINK.stats.tx_retries++;
+  }
+  _tx_continue();
+  debug_led(0);
+}
+
 static void _tx_done(osjob_t *job) {
   debug_fun(); debug_opmode();
   if(BLINK.opmode & OP_TXBCN) {
@@ -558,11 +1223,38 @@ static void _tx_done(osjob_t *job) {
     BLINK.opmode &= ~(OP_TXBCN);
     BLINK.pending &= ~(PEND_BEACON_TX);
   } else if(BLINK.opmode & OP_TXDATA) {
-    // clear the TXDATA and PEND_DATA_TX bits
     BLINK.opmode &= ~(OP_TXDATA);
-    BLINK.pending &= ~(PEND_DATA_TX);
-    // report to the upper layer
-    _report_event(EVENT_TXCOMPLETE);
+    if(BLINK.cfg.ack) {
+      // listen for the parent's ACK right after the frame
+      struct blink_nbr_t *n = _nbr_find(BLINK.parent);
+      if(n != NULL) {
+        n->link_tx++;
+      }
+      BLINK.rx_time = ENZO.txend + ms2osticks(ACK_DELAY_ms - RX_MARGIN_ms);
+      BLINK.rx_syms = osticks2us(ms2osticks(2 * RX_MARGIN_ms)) / calcSymTimeUs(ENZO.rps) + RX_MIN_SYMS;
+      os_setTimedCallback(&_receive_job, BLINK.rx_time - RX_RAMPUP, FUNC_ADDR(_ack_rx));
+    } else {
+      _tx_finish(1);
+      _tx_continue();
+    }
+  } else if(BLINK.opmode & OP_TXDOWN) {
+    BLINK.opmode &= ~(OP_TXDOWN);
+    if(BLINK.opmode & OP_ROOT) {
+      // root goes back to listening
+      _set_radio_callback(FUNC_ADDR(_rx_root_done));
+      os_radio(RADIO_RXON);
+    } else {
+      _next_minislot();
+    }
+  } else if(BLINK.opmode & OP_TXACK) {
+    BLINK.opmode &= ~(OP_TXACK);
+    if(BLINK.opmode & OP_ROOT) {
+      // root keeps listening
+      _set_radio_callback(FUNC_ADDR(_rx_root_done));
+      os_radio(RADIO_RXON);
+    } else {
+      _rx_continue(1);
+    }
   } else {
     // TODO transmission done when we didn't expect it, err?
     ASSERT(0);
@@ -571,19 +1263,706 @@ static void _tx_done(osjob_t *job) {
 }
 
 /* util */
+// done with the data frame on air, report our own records to the upper layer
+static void _tx_finish(u1_t delivered) {
+  tx_len = 0;
+  if(BLINK.tx_local) {
+    _report_event(delivered ? EVENT_TXCOMPLETE : EVENT_TXFAILED);
+  }
+}
+
+// send the next (or a retried) frame if it still fits in this mini-slot,
+// otherwise move on
+static void _tx_continue(void) {
+  ostime_t next = os_getTime() + ms2osticks(TX_BURST_GAP_ms);
+  if(_tx_ready() && _minislot_fits(next)) {
+    os_setTimedCallback(&_transmit_job, next, FUNC_ADDR(_data_tx));
+  } else {
+    _next_minislot();
+  }
+}
+
+// keep listening if the sender may have more frames for this mini-slot,
+// otherwise move on
+static void _rx_continue(u1_t got) {
+  if(got && _minislot_fits(os_getTime() + ms2osticks(TX_BURST_GAP_ms))) {
+    BLINK.rx_syms = osticks2us(ms2osticks(2 * TX_BURST_GAP_ms)) / calcSymTimeUs(ENZO.rps) + RX_MIN_SYMS;
+#if (TRUE == BLINK_USE_LPL)
+    // sample once the next frame's preamble has started
+    BLINK.rx_time = os_getTime() + ms2osticks(TX_BURST_GAP_ms + RX_MARGIN_ms);
+    os_setTimedCallback(&_receive_job, BLINK.rx_time - RX_RAMPUP, FUNC_ADDR(_data_rx));
+#else
+    BLINK.rx_time = os_getTime();
+    os_setCallback(&_receive_job, FUNC_ADDR(_data_rx));
+#endif
+  } else {
+    _next_minislot();
+  }
+}
+
 static void _set_radio_callback(osjobcb_t callback) {
   os_clearCallback(&ENZO.osjob);
   ENZO.osjob.func = callback;
 }
 
+// start time of the received frame (rxtime marks its end)
+static ostime_t _rx_start_time(void) {
+  return ENZO.rxtime - calcAirTime(ENZO.rps, ENZO.dataLen);
+}
+
+// schedule an RX window around an expected frame start
+// (wide enough for the last sync error plus drift since the last beacon)
+static void _schedule_rx(ostime_t expected, osjobcb_t callback) {
+  ostime_t elapsed  = expected - BLINK.beacon_time;
+  // (most of the drift is corrected for once it's estimated)
+  s2_t ppm = drift_len >= DRIFT_MIN_SAMPLES ? DRIFT_RESIDUAL_ppm : CLOCK_DRIFT_ppm;
+  ostime_t unc = BLINK.sync_err + (elapsed / 1000) * ppm / 1000 + ms2osticks(RX_MARGIN_ms);
+  // don't reach into a neighbouring mini-slot
+  ostime_t max = BLINK.minislots > 1 && _is_data_slot() ? ms2osticks(MINISLOT_GUARD_ms) : SLOT_GUARD_ticks;
+#if (TRUE == BLINK_USE_LPL)
+  // the sender's preamble must span the whole window and a CAD
+  ostime_t span = us2osticks((u4_t)(_data_preamble() - SCAN_CAD_SYMS) * calcSymTimeUs(ENZO.rps)) / 2;
+  if(_is_data_slot() && max > span) {
+    max = span;
+  }
+#endif
+  if(unc > max) {
+    unc = max;
+  }
+  u4_t syms = (u4_t)osticks2us(2 * unc) / calcSymTimeUs(ENZO.rps) + RX_MIN_SYMS;
+  BLINK.rx_syms = syms > 0xFF ? 0xFF : syms;
+  BLINK.rx_time = expected - unc;
+#if (TRUE == BLINK_USE_LPL)
+  if(_is_data_slot()) {
+    // sample after the latest possible start, the preamble of the
+    // earliest one still covers the CAD
+    BLINK.rx_time = expected + unc;
+  }
+#endif
+  os_setTimedCallback(&_receive_job, BLINK.rx_time - RX_RAMPUP, callback);
+}
+
+// local start time of the slot with the given slot count, on the grid of
+// the slot we last synced on, corrected for our clock drift
+static ostime_t _slot_start(u4_t slots) {
+  ostime_t elapsed = (s4_t)(slots - BLINK.anchor_slots) * TIME_SLOT_ticks;
+  return BLINK.anchor + elapsed + (s8_t)elapsed * BLINK.drift_ppm / 1000000;
+}
+
+// sync the slot grid on the current slot, and wake up for the next one
+static void _anchor(ostime_t slot_start) {
+  BLINK.anchor = slot_start;
+  BLINK.anchor_slots = BLINK.slots;
+  os_setTimedCallback(&_wakeup_job, _slot_start(BLINK.slots + 1), FUNC_ADDR(_wakeup));
+}
+
+// add a parent beacon to the drift estimator: the least squares slope of
+// our clock's error against network time over the last DRIFT_SAMPLES beacons
+static void _drift_sample(u4_t net_ms, ostime_t local) {
+  drift_samples[drift_next].net_ms = net_ms;
+  drift_samples[drift_next].local  = local;
+  drift_next = (drift_next + 1) % DRIFT_SAMPLES;
+  if(drift_len < DRIFT_SAMPLES) {
+    drift_len++;
+  }
+  if(drift_len < DRIFT_MIN_SAMPLES) {
+    return;
+  }
+
+  // relative to the oldest sample
+  u1_t first = (drift_next + DRIFT_SAMPLES - drift_len) % DRIFT_SAMPLES;
+  s8_t sx = 0, se = 0, sxx = 0, sxe = 0;
+  for(u1_t i = 0; i < drift_len; i++) {
+    u1_t k = (first + i) % DRIFT_SAMPLES;
+    u4_t dt = drift_samples[k].net_ms - drift_samples[first].net_ms;
+    s8_t x = dt / DRIFT_UNIT_ms;
+    s8_t e = (drift_samples[k].local - drift_samples[first].local) - ms2osticks(dt);
+    sx  += x;
+    se  += e;
+    sxx += x * x;
+    sxe += x * e;
+  }
+  s8_t den = drift_len * sxx - sx * sx;
+  if(den <= 0) {
+    // all from the same beacon round
+    return;
+  }
+  // ticks per unit to ppm
+  s8_t ppm = (drift_len * sxe - sx * se) * (1000000000 / (DRIFT_UNIT_ms * OSTICKS_PER_SEC)) / den;
+  if(ppm > 2 * CLOCK_DRIFT_ppm || ppm < -2 * CLOCK_DRIFT_ppm) {
+    // not a crystal, someone lost sync
+    drift_len = 0;
+    return;
+  }
+  BLINK.drift_ppm = ppm;
+}
+
+// after a beacon round we listened to: sleep through the next ones once
+// our parent's beacons keep arriving where the drift corrected clock put
+// them, doubling the run every time up to BCN_SKIP_MAX rounds
+static void _bcn_adapt(void) {
+  struct blink_nbr_t *p = _nbr_find(BLINK.parent);
+  if(p == NULL || !p->heard || drift_len < DRIFT_MIN_SAMPLES ||
+     BLINK.sync_err > ms2osticks(RX_MARGIN_ms)) {
+    _bcn_listen();
+    return;
+  }
+  if(BLINK.bcn_streak < BCN_STABLE_EPOCHS) {
+    BLINK.bcn_streak++;
+  }
+  if(BLINK.bcn_streak >= BCN_STABLE_EPOCHS && BCN_SKIP_MAX > 0) {
+    BLINK.bcn_run = BLINK.bcn_run == 0 ? 1 :
+                    BLINK.bcn_run * 2 > BCN_SKIP_MAX ? BCN_SKIP_MAX : BLINK.bcn_run * 2;
+    BLINK.bcn_skip = BLINK.bcn_run;
+  }
+}
+
+// something's off, listen to every beacon round again
+static void _bcn_listen(void) {
+  BLINK.bcn_skip   = 0;
+  BLINK.bcn_run    = 0;
+  BLINK.bcn_streak = 0;
+}
+
+// account radio on-time of the ending RX window
+static void _rx_stats(void) {
+  ostime_t on = os_getTime() - BLINK.rx_time;
+  if(BLINK.opmode & OP_RXBCN) {
+    BLINK.stats.bcn_rx_slots++;
+    BLINK.stats.bcn_rx_ticks += on;
+  } else {
+    BLINK.stats.data_rx_slots++;
+    BLINK.stats.data_rx_ticks += on;
+  }
+  if(on > BLINK.stats.rx_ticks_max) {
+    BLINK.stats.rx_ticks_max = on;
+  }
+}
+
+// return true iff the frame structure works at the current data rate
+static u1_t _cfg_valid(const struct blink_cfg_t *cfg) {
+  if(cfg->beacon_slots == 0 || cfg->beacon_slots > MAX_BEACON_HOPS ||
+     cfg->slots <= cfg->beacon_slots ||
+     (cfg->sched != SCHED_NODEID && cfg->sched != SCHED_PIPELINE)) {
+    return 0;
+  }
+  // a full frame (and its ACK) and the drift guards must fit in a slot at this data rate
+  if(_exchange_time(cfg) + 2 * ms2osticks(cfg->drift_ms) >= ms2osticks(cfg->slot_ms)) {
+    return 0;
+  }
+  // every half or group of the data schedule needs a mini-slot, next to
+  // the downlink ones
+  return _vslots(cfg) >= _vslot_groups(cfg);
+}
+
+// switch to the announced frame structure once its epoch has started
+static void _apply_config(void) {
+  if((s2_t)(BLINK.epoch - BLINK.next.epoch) >= 0) {
+    if(BLINK.next.cfg.slot_ms != BLINK.cfg.slot_ms) {
+      // slots change length from this one on
+      BLINK.anchor = _slot_start(BLINK.slots);
+      BLINK.anchor_slots = BLINK.slots;
+    }
+    BLINK.cfg = BLINK.next.cfg;
+    _minislot_setup();
+  }
+}
+
+// adopt the epoch and frame structure announced in a beacon
+static void _beacon_config(beacon_t *b) {
+  if((BLINK.opmode & OP_TRACK) && (s2_t)(b->epoch - BLINK.epoch) > 0) {
+    // slept through whole epochs
+    BLINK.stats.epoch_skips += (u2_t)(b->epoch - BLINK.epoch);
+  }
+  BLINK.epoch = b->epoch;
+  if((b->fields & (1 << BCN_CONFIG)) && _cfg_valid(&b->next.cfg)) {
+    BLINK.next = b->next;
+    // catches up at once if we missed the switch
+    _apply_config();
+  }
+  if((b->fields & (1 << BCN_DIGEST)) && b->digest != _cfg_digest(&BLINK.cfg)) {
+    // out of step, until the root repeats the structure
+    BLINK.stats.cfg_mismatch++;
+    _bcn_listen();
+  }
+}
+
+// parse the beacon in the radio buffer, returns 0 if it's malformed or
+// misses a required field
+static u1_t _beacon_parse(beacon_t *b) {
+  os_copyMem(&b->header, ENZO.frame, SIZEOFEXPR(header_t));
+  b->fields = 0;
+  u2_t off = SIZEOFEXPR(header_t);
+  while(off + SIZEOFEXPR(tlv_t) <= ENZO.dataLen) {
+    tlv_t *t = (tlv_t*)(ENZO.frame + off);
+    u1_t *v = ENZO.frame + off + SIZEOFEXPR(tlv_t);
+    off += SIZEOFEXPR(tlv_t) + t->len;
+    if(off > ENZO.dataLen) {
+      return 0;
+    }
+    void *field;
+    u1_t len;
+    switch(t->type) {
+      case BCN_EPOCH:  field = &b->epoch;  len = SIZEOFEXPR(b->epoch);  break;
+      case BCN_TIME:   field = &b->time;   len = SIZEOFEXPR(b->time);   break;
+      case BCN_ETX:    field = &b->etx;    len = SIZEOFEXPR(b->etx);    break;
+      case BCN_DIGEST: field = &b->digest; len = SIZEOFEXPR(b->digest); break;
+      case BCN_CONFIG: field = &b->next;   len = SIZEOFEXPR(b->next);   break;
+      default:
+        // from a newer version, skip it
+        continue;
+    }
+    if(t->len != len) {
+      return 0;
+    }
+    os_copyMem(field, v, len);
+    b->fields |= (1 << t->type);
+  }
+  return off == ENZO.dataLen &&
+         (b->fields & ((1 << BCN_EPOCH) | (1 << BCN_TIME) | (1 << BCN_ETX))) ==
+                      ((1 << BCN_EPOCH) | (1 << BCN_TIME) | (1 << BCN_ETX));
+}
+
+// append a TLV field to the frame in the radio buffer at off, returns the new length
+static u1_t _tlv_put(u1_t off, u1_t type, const void *value, u1_t len) {
+  ASSERT(off + SIZEOFEXPR(tlv_t) + len <= MAX_LEN_FRAME);
+  tlv_t *t = (tlv_t*)(ENZO.frame + off);
+  t->type = type;
+  t->len  = len;
+  os_copyMem(ENZO.frame + off + SIZEOFEXPR(tlv_t), value, len);
+  return off + SIZEOFEXPR(tlv_t) + len;
+}
+
+// CRC-16 (CCITT) over a frame structure
+static u2_t _cfg_digest(const struct blink_cfg_t *cfg) {
+  const u1_t *p = (const u1_t*)cfg;
+  u2_t crc = 0xFFFF;
+  for(u1_t i = 0; i < SIZEOFEXPR(*cfg); i++) {
+    crc ^= (u2_t)p[i] << 8;
+    for(u1_t b = 0; b < 8; b++) {
+      crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : (crc << 1);
+    }
+  }
+  return crc;
+}
+
+// number of mini-slots per data slot: each fits a full frame plus guards
+// at the current data rate in the usable part of a slot
+static u1_t _minislots(const struct blink_cfg_t *cfg) {
+  ostime_t usable = ms2osticks(cfg->slot_ms) - 2 * ms2osticks(cfg->drift_ms);
+  ostime_t len = _exchange_time(cfg) + 2 * ms2osticks(MINISLOT_GUARD_ms);
+  u4_t n = usable / len;
+  return n < 1 ? 1 : n > 0xFF ? 0xFF : n;
+}
+
+// airtime of a full data frame, and its ACK if used
+static ostime_t _exchange_time(const struct blink_cfg_t *cfg) {
+  ostime_t t = calcAirTimePre(ENZO.rps, MAX_LEN_FRAME, _data_preamble());
+  if(cfg->ack) {
+    t += ms2osticks(ACK_DELAY_ms) + calcAirTime(ENZO.rps, SIZEOFEXPR(header_t));
+  }
+  return t;
+}
+
+// split the data slots of the active frame structure into mini-slots
+static void _minislot_setup(void) {
+  BLINK.minislots = _minislots(&BLINK.cfg);
+  BLINK.minislot_ticks = (TIME_SLOT_ticks - 2 * SLOT_GUARD_ticks) / BLINK.minislots;
+  BLINK.vslots = _vslots(&BLINK.cfg);
+}
+
+// frame start time of mini-slot k of the current data slot
+static ostime_t _minislot_time(u1_t k) {
+  return BLINK.slot_time + SLOT_GUARD_ticks + k * BLINK.minislot_ticks;
+}
+
+// return true iff a data frame started at time t ends within the current
+// mini-slot, or the unassigned mini-slots following it in this data slot
+static u1_t _minislot_fits(ostime_t t) {
+  u1_t last = BLINK.minislot;
+  while(last + 1 < BLINK.minislots && _vslot(last + 1) >= BLINK.vslots &&
+        !_is_down_vslot(_vslot(last + 1))) {
+    last++;
+  }
+  ostime_t end = _minislot_time(last + 1) - ms2osticks(MINISLOT_GUARD_ms);
+  return end - (t + _exchange_time(&BLINK.cfg)) > 0;
+}
+
+// transmit or listen in the current mini-slot of a data slot
+static void _schedule_minislot(void) {
+  // skip the mini-slots we neither send nor listen in
+  u2_t v = _vslot(BLINK.minislot);
+  while(!_is_down_vslot(v) && !_tx_ready() && !_vslot_listen(v)) {
+    if(BLINK.minislot + 1 == BLINK.minislots) {
+      // nothing for us in the rest of this data slot
+      return;
+    }
+    BLINK.minislot++;
+    v++;
+  }
+  ostime_t start = _minislot_time(BLINK.minislot);
+  if(_is_down_vslot(v)) {
+    // downlink, the mini-slot of hop h carries frames from hop h to hop h + 1
+    u1_t hop = v - _down_vslot(0);
+    if(hop == BLINK.hop && txq[TXQ_DOWN].len > 0) {
+      os_setTimedCallback(&_transmit_job, start, FUNC_ADDR(_down_tx));
+    } else if(hop + 1 == BLINK.hop) {
+      _schedule_rx(start, FUNC_ADDR(_data_rx));
+    } else {
+      _next_minislot();
+    }
+  } else if(_tx_ready()) {
+    // our mini-slot and something to send for it, transmit
+    os_setTimedCallback(&_transmit_job, start, FUNC_ADDR(_data_tx));
+  } else {
+    // listen
+    _schedule_rx(start, FUNC_ADDR(_data_rx));
+  }
+}
+
+// move on to the next mini-slot of the current data slot, if any
+static void _next_minislot(void) {
+  if(_is_data_slot() && BLINK.minislot + 1 < BLINK.minislots) {
+    BLINK.minislot++;
+    _schedule_minislot();
+  }
+}
+
+// return true iff the received frame has the given type and a valid length for it
+static u1_t _frame_valid(packet_type_t type) {
+  header_t *h = (header_t*)ENZO.frame;
+  if(ENZO.dataLen < SIZEOFEXPR(header_t) || h->type != type) {
+    return 0;
+  }
+  switch(type) {
+    case BEACON:
+      // (parsing it into beacon_rx)
+      return _beacon_parse(&beacon_rx);
+    case DATA:
+      return _records_valid();
+    case ACK:
+      return ENZO.dataLen == SIZEOFEXPR(header_t);
+    case DOWN: {
+      // a single record
+      return _records_valid() &&
+             SIZEOFEXPR(header_t) + _record_unpack(SIZEOFEXPR(header_t), NULL) == ENZO.dataLen;
+    }
+    default:
+      return 0;
+  }
+}
+
+// return true iff the received data frame is a whole number of sane records
+static u1_t _records_valid(void) {
+  u1_t off = SIZEOFEXPR(header_t);
+  if(ENZO.dataLen <= off) {
+    return 0;
+  }
+  while(off < ENZO.dataLen) {
+    u1_t n = _record_unpack(off, NULL);
+    if(n == 0) {
+      return 0;
+    }
+    off += n;
+  }
+  return 1;
+}
+
+// bytes - size of a record packed in a frame sent by sender
+static u1_t _record_size(const record_t *r, u2_t sender) {
+  return REC_HDR_MIN + (r->hdr.src != sender ? SIZEOFEXPR(r->hdr.src) : 0) +
+         (r->hdr.path != 0 ? SIZEOFEXPR(r->hdr.path) : 0) + r->hdr.len;
+}
+
+// pack a record into a frame sent by sender, return its size
+static u1_t _record_pack(u1_t *buf, const record_t *r, u2_t sender) {
+  u1_t n = REC_HDR_MIN;
+  buf[0] = r->hdr.len;
+  buf[1] = r->hdr.seq;
+  buf[2] = r->hdr.age;
+  if(r->hdr.src != sender) {
+    buf[0] |= REC_SRC;
+    os_copyMem(buf + n, &r->hdr.src, SIZEOFEXPR(r->hdr.src));
+    n += SIZEOFEXPR(r->hdr.src);
+  }
+  if(r->hdr.path != 0) {
+    buf[0] |= REC_PATH;
+    os_copyMem(buf + n, &r->hdr.path, SIZEOFEXPR(r->hdr.path));
+    n += SIZEOFEXPR(r->hdr.path);
+  }
+  os_copyMem(buf + n, r->payload, r->hdr.len);
+  return n + r->hdr.len;
+}
+
+// unpack the record at off in the received frame (unless r is NULL), return
+// its packed size, 0 if it's malformed or doesn't fit the frame
+static u1_t _record_unpack(u1_t off, record_t *r) {
+  const u1_t *buf = ENZO.frame + off;
+  if(off + REC_HDR_MIN > ENZO.dataLen) {
+    return 0;
+  }
+  u1_t len = buf[0] & REC_LEN_MASK;
+  u1_t n = REC_HDR_MIN + ((buf[0] & REC_SRC) ? SIZEOFEXPR(r->hdr.src) : 0) +
+           ((buf[0] & REC_PATH) ? SIZEOFEXPR(r->hdr.path) : 0);
+  if(len > MAX_PAYLOAD_LEN || off + n + len > ENZO.dataLen) {
+    return 0;
+  }
+  if(r != NULL) {
+    r->hdr.len  = len;
+    r->hdr.seq  = buf[1];
+    r->hdr.age  = buf[2];
+    r->hdr.src  = ((header_t*)ENZO.frame)->src;
+    r->hdr.path = 0;
+    n = REC_HDR_MIN;
+    if(buf[0] & REC_SRC) {
+      os_copyMem(&r->hdr.src, buf + n, SIZEOFEXPR(r->hdr.src));
+      n += SIZEOFEXPR(r->hdr.src);
+    }
+    if(buf[0] & REC_PATH) {
+      os_copyMem(&r->hdr.path, buf + n, SIZEOFEXPR(r->hdr.path));
+      n += SIZEOFEXPR(r->hdr.path);
+    }
+    os_copyMem(r->payload, buf + n, len);
+  }
+  return n + len;
+}
+
+// add a record to a tx queue class, applying its drop policy when full
+// returns 0 if the record was dropped
+static u1_t _txq_put(u1_t cls, record_t *r) {
+  ASSERT(cls < TXQ_CLASSES);
+  if(txq[cls].len == TX_QUEUE_DEPTH) {
+    BLINK.stats.txq_dropped[cls]++;
+    if(BLINK.txq_policy[cls] == TXQ_DROP_NEWEST) {
+      return 0;
+    }
+    // TXQ_DROP_OLDEST
+    txq[cls].head = (txq[cls].head + 1) % TX_QUEUE_DEPTH;
+    txq[cls].len--;
+  }
+  u1_t tail = (txq[cls].head + txq[cls].len) % TX_QUEUE_DEPTH;
+  os_copyMem(&txq[cls].rec[tail], r, SIZEOFEXPR(record_hdr_t) + r->hdr.len);
+  txq[cls].since[tail] = BLINK.slots;
+  txq[cls].len++;
+  BLINK.stats.txq_queued[cls]++;
+  if(txq[cls].len > BLINK.stats.txq_max[cls]) {
+    BLINK.stats.txq_max[cls] = txq[cls].len;
+  }
+  BLINK.pending |= PEND_DATA_TX;
+  return 1;
+}
+
+// next record to send from the highest priority non-empty class in the
+// given set (bit mask of classes), optionally returning its class
+static record_t* _txq_peek(u1_t classes, u1_t *cls) {
+  for(u1_t c = 0; c < TXQ_CLASSES; c++) {
+    if((classes & (1 << c)) && txq[c].len > 0) {
+      if(cls) {
+        *cls = c;
+      }
+      return &txq[c].rec[txq[c].head];
+    }
+  }
+  return NULL;
+}
+
+// drop the head record of a tx queue class
+static void _txq_pop(u1_t cls) {
+  ASSERT(cls < TXQ_CLASSES && txq[cls].len > 0);
+  txq[cls].head = (txq[cls].head + 1) % TX_QUEUE_DEPTH;
+  txq[cls].len--;
+  if(_txq_peek(0xFF, NULL) == NULL) {
+    BLINK.pending &= ~(PEND_DATA_TX);
+  }
+}
+
+// number of mini-slots a data schedule assigns: all mini-slots of the data
+// slots, but for the downlink ones and the one before them
+static u2_t _vslots(const struct blink_cfg_t *cfg) {
+  u2_t n = (cfg->slots - cfg->beacon_slots) * _minislots(cfg);
+  u1_t down = cfg->down ? 1 + cfg->beacon_slots : 0;
+  return n > down ? n - down : 0;
+}
+
+// number of halves or groups the data schedule splits into
+static inline u1_t _vslot_groups(const struct blink_cfg_t *cfg) {
+  return cfg->sched == SCHED_PIPELINE ? cfg->beacon_slots : 2;
+}
+
+// schedule index of mini-slot k of the current data slot
+static inline u2_t _vslot(u1_t k) {
+  return (BLINK.slot - BEACON_SLOTS) * BLINK.minislots + k;
+}
+
+// pipeline group of the nodes at the given hop: deepest hop first, so relays
+// forward what they got within the epoch (node hops run from 1 up to the
+// number of beacon slots)
+static inline u1_t _hop_group(u1_t hop) {
+  return hop < BEACON_SLOTS ? BEACON_SLOTS - hop : 0;
+}
+
+// our mini-slot within a half or group of the data schedule, spread over
+// all of it by a hash of our id (Knuth's multiplicative one), and moved
+// by every change of the salt
+static u2_t _vslot_pick(void) {
+  u4_t h = (((u4_t)BLINK.vslot_salt << 16) | BLINK.nodeid) * 2654435761u;
+  return (h >> 16) % (BLINK.vslots / _vslot_groups(&BLINK.cfg));
+}
+
+// our source mini-slot, for local and forwarded records
+static inline u2_t _source_vslot() {
+  if(BLINK.cfg.sched == SCHED_PIPELINE) {
+    return _hop_group(BLINK.hop) * (BLINK.vslots / BEACON_SLOTS) + _vslot_pick();
+  }
+  return _vslot_pick();
+}
+
+// our forwarding mini-slot, for relayed records only (VSLOT_NONE if none)
+static inline u2_t _forward_vslot() {
+  if(BLINK.cfg.sched == SCHED_PIPELINE) {
+    // the source mini-slot already comes after all our children's
+    return VSLOT_NONE;
+  }
+  return BLINK.vslots / 2 + _vslot_pick();
+}
+
+// return true iff we listen in mini-slot v of the data schedule: where our
+// children may send, and in our source mini-slot to notice others in it
+static u1_t _vslot_listen(u2_t v) {
+  if(v >= BLINK.vslots) {
+    return 0;
+  }
+  if(BLINK.cfg.sched == SCHED_PIPELINE) {
+    return v / (BLINK.vslots / BEACON_SLOTS) == _hop_group(BLINK.hop + 1) || v == _source_vslot();
+  }
+  return 1;
+}
+
+// return true iff we have a frame to (re)send in the current mini-slot
+static u1_t _tx_ready(void) {
+  u1_t classes = _tx_classes();
+  return classes && (tx_len || _txq_peek(classes, NULL) != NULL);
+}
+
+// tx queue classes (bit mask) we may send from in the current mini-slot
+static u1_t _tx_classes(void) {
+  if(!_is_data_slot()) {
+    return 0;
+  }
+  u2_t v = _vslot(BLINK.minislot);
+  if(v == _source_vslot()) {
+    return (1 << TXQ_LOCAL) | (1 << TXQ_FORWARD);
+  } else if(v != VSLOT_NONE && v == _forward_vslot()) {
+    return (1 << TXQ_FORWARD);
+  }
+  return 0;
+}
+
+// first downlink mini-slot, for frames sent by nodes at the given hop
+static inline u2_t _down_vslot(u1_t hop) {
+  return DATA_SLOTS * BLINK.minislots - BEACON_SLOTS + hop;
+}
+
+// return true iff mini-slot v of the data schedule is a downlink mini-slot
+static inline u1_t _is_down_vslot(u2_t v) {
+  return BLINK.cfg.down && v >= _down_vslot(0);
+}
+
+// root: remember how a delivered record got here as the route back to its
+// source, making room by forgetting the least recently heard node
+static void _learn_route(record_t *r, u2_t via) {
+  struct blink_route_t *rt = _route_find(r->hdr.src);
+  for(u1_t i = 0; i < ROUTE_CACHE_SIZE && rt == NULL; i++) {
+    if(!BLINK.routes[i].used) {
+      rt = &BLINK.routes[i];
+    }
+  }
+  if(rt == NULL) {
+    rt = &BLINK.routes[0];
+    for(u1_t i = 1; i < ROUTE_CACHE_SIZE; i++) {
+      if((s2_t)(BLINK.routes[i].epoch - rt->epoch) < 0) {
+        rt = &BLINK.routes[i];
+      }
+    }
+  }
+  if(rt->dest != r->hdr.src || !rt->used) {
+    rt->sent = 0;
+  }
+  rt->used  = 1;
+  rt->dest  = r->hdr.src;
+  rt->via   = via;
+  rt->path  = r->hdr.path;
+  rt->epoch = BLINK.epoch;
+}
+
+// root: cached route to a node, NULL if we have none
+static struct blink_route_t* _route_find(u2_t dest) {
+  for(u1_t i = 0; i < ROUTE_CACHE_SIZE; i++) {
+    if(BLINK.routes[i].used && BLINK.routes[i].dest == dest) {
+      return &BLINK.routes[i];
+    }
+  }
+  return NULL;
+}
+
+// relays: path index (1 based) of a child, adding it to the child table
+// (an entry is only reused once its child has gone quiet for longer than the
+// root keeps routes through it, its records may reach the root an epoch
+// later; PATH_NOROUTE if the table is full)
+static u1_t _child_index(u2_t id) {
+  u1_t free = CHILD_TABLE_SIZE;
+  for(u1_t i = 0; i < CHILD_TABLE_SIZE; i++) {
+    if(BLINK.children[i] == id) {
+      BLINK.child_epoch[i] = BLINK.epoch;
+      return i + 1;
+    }
+    if(free == CHILD_TABLE_SIZE && (BLINK.children[i] == ROOT_ID ||
+       (u2_t)(BLINK.epoch - BLINK.child_epoch[i]) > ROUTE_TIMEOUT + 1)) {
+      free = i;
+    }
+  }
+  if(free == CHILD_TABLE_SIZE) {
+    // full, the record carries no way back through us (but still shows
+    // it was relayed here)
+    BLINK.stats.child_overflow++;
+    return PATH_NOROUTE;
+  }
+  BLINK.children[free] = id;
+  BLINK.child_epoch[free] = BLINK.epoch;
+  return free + 1;
+}
+
+// return true iff we've received the record before, remember it otherwise
+static u1_t _duplicate(record_t *r) {
+  u4_t key = ((u4_t)r->hdr.src << 8) | r->hdr.seq;
+  for(u1_t i = 0; i < DUP_CACHE_SIZE; i++) {
+    if(dup_cache[i] == key) {
+      return 1;
+    }
+  }
+  // replace the oldest entry
+  dup_cache[dup_next] = key;
+  dup_next = (dup_next + 1) % DUP_CACHE_SIZE;
+  return 0;
+}
+
+// forget a record remembered by _duplicate, it wasn't taken after all
+static void _dup_forget(record_t *r) {
+  u4_t key = ((u4_t)r->hdr.src << 8) | r->hdr.seq;
+  for(u1_t i = 0; i < DUP_CACHE_SIZE; i++) {
+    if(dup_cache[i] == key) {
+      dup_cache[i] = 0;
+    }
+  }
+}
+
 // rebroadcast a beacon if it hasn't reached it maximum hops yet
-static void _rebroadcast_beacon(beacon_msg_t *b) {
+static void _rebroadcast_beacon(beacon_t *b) {
   // setup the beacon for rebroadcast if it hasn't reached its max yet
-  if(b->header.hop < MAX_BEACON_HOPS) {
+  // (a beacon is sent in the beacon slot matching its hop, it's rebuilt
+  // from what we adopted from it when it goes out)
+  if(b->header.hop + 1 < BEACON_SLOTS) {
     // schedule beacon for rebroadcast
-    os_copyMem(&beacon_tx, b, SIZEOFEXPR(beacon_msg_t));
-    // increment the hop
-    beacon_tx.header.hop++;
     BLINK.pending |= PEND_BEACON_TX;
   }
 }
@@ -591,13 +1970,23 @@ static void _rebroadcast_beacon(beacon_msg_t *b) {
 // count missing beacons, restart sync when lost too many
 static void _missed_beacon() {
   BLINK.missed_beacons++;
+  if(BLINK.slot + 1 == BLINK.hop) {
+    // our parent's beacon, listen to every round again (the other beacon
+    // slots may just be empty)
+    _bcn_listen();
+  }
 
   if(BLINK.missed_beacons > MAX_MISSED_BEACONS) {
     // lost sync
+    _bcn_listen();
     BLINK.opmode &= ~(OP_TRACK);
     BLINK.opmode |= OP_SCAN;
     // cancel wakeup
     os_clearCallback(&_wakeup_job);
+    // the drift estimate stays, but needs fresh beacons
+    drift_len = 0;
+    // start over with our neighbours
+    os_clearMem((xref2u1_t)&BLINK.nbr, SIZEOFEXPR(BLINK.nbr));
     // report and schedule resync
     _report_event(EVENT_LOST_SYNC);
     blink_start_sync();
@@ -611,11 +2000,194 @@ static void _report_event(event_t ev) {
   on_event(ev);
 }
 
+// account the latency of a record delivered to the sink by its source hop
+static void _latency_stats(record_t *r) {
+  // every relay on the way left a non-zero child index (or PATH_NOROUTE)
+  // in the path
+  u1_t hop = 1;
+  for(u1_t i = 0; i < PATH_MAX; i++) {
+    if(PATH_MASK & (r->hdr.path >> (i * PATH_SHIFT))) {
+      hop++;
+    }
+  }
+  BLINK.stats.hop_records[hop - 1]++;
+  BLINK.stats.hop_age[hop - 1] += r->hdr.age;
+  if(r->hdr.age < TIME_SLOTS) {
+    BLINK.stats.hop_in_epoch[hop - 1]++;
+  }
+  if(r->hdr.age > BLINK.stats.hop_age_max[hop - 1]) {
+    BLINK.stats.hop_age_max[hop - 1] = r->hdr.age;
+  }
+}
+
+// neighbour table entry of a node, NULL if we haven't heard it
+static struct blink_nbr_t* _nbr_find(u2_t id) {
+  for(u1_t i = 0; i < NBR_TABLE_SIZE; i++) {
+    if(BLINK.nbr[i].used && BLINK.nbr[i].id == id) {
+      return &BLINK.nbr[i];
+    }
+  }
+  return NULL;
+}
+
+// account a received beacon to its sender, making room for a new neighbour
+// by forgetting the least reliable one (never our parent), NULL if there's
+// no room
+static struct blink_nbr_t* _nbr_update(beacon_t *b) {
+  s2_t rssi = radio_rssi2dBm(ENZO.rssi);
+  struct blink_nbr_t *n = _nbr_find(b->header.src);
+  if(n == NULL) {
+    for(u1_t i = 0; i < NBR_TABLE_SIZE && (n == NULL || n->used); i++) {
+      struct blink_nbr_t *e = &BLINK.nbr[i];
+      if(!e->used || (e->id != BLINK.parent && (n == NULL || e->prr < n->prr))) {
+        n = e;
+      }
+    }
+    if(n == NULL) {
+      // the table only holds our parent
+      return NULL;
+    }
+    n->used = 1;
+    n->id   = b->header.src;
+    n->prr  = NBR_PRR_INIT;
+    n->rssi = rssi;
+    n->snr  = ENZO.snr;
+  } else {
+    n->rssi += (rssi - n->rssi) / NBR_EWMA_WEIGHT;
+    n->snr  += (ENZO.snr - n->snr) / NBR_EWMA_WEIGHT;
+  }
+  n->hop   = b->header.hop;
+  n->etx   = b->etx;
+  n->heard = 1;
+  return n;
+}
+
+// fold this epoch's beacons into the reception ratios, forget neighbours
+// we hardly hear anymore
+static void _nbr_epoch(void) {
+  for(u1_t i = 0; i < NBR_TABLE_SIZE; i++) {
+    struct blink_nbr_t *e = &BLINK.nbr[i];
+    if(!e->used) {
+      continue;
+    }
+    if(e->heard) {
+      e->prr += (0xFF - e->prr + NBR_EWMA_WEIGHT - 1) / NBR_EWMA_WEIGHT;
+    } else if(e->hop != BLINK.hop) {
+      // (we can't hear it while sending our own beacon in its slot)
+      e->prr -= (e->prr + NBR_EWMA_WEIGHT - 1) / NBR_EWMA_WEIGHT;
+    }
+    e->heard = 0;
+    if(e->prr < NBR_PRR_MIN && e->id != BLINK.parent) {
+      e->used = 0;
+    }
+  }
+}
+
+// expected transmissions over the link to a neighbour, beacons only show
+// one direction so assume the link is symmetric: 1 / prr^2
+static u1_t _link_etx(struct blink_nbr_t *e) {
+  if(e->prr == 0) {
+    return ETX_MAX;
+  }
+  u4_t etx = (u4_t)ETX_ONE * 0xFF * 0xFF / ((u4_t)e->prr * e->prr);
+  // links close to the demodulation floor come and go, count them double
+  s2_t floor = -20 - 10 * getSf(ENZO.rps);
+  if(e->snr < floor + NBR_SNR_MARGIN_qdB) {
+    etx *= 2;
+  }
+  return etx > ETX_MAX ? ETX_MAX : etx;
+}
+
+// expected transmissions to the sink through a neighbour
+static u1_t _path_etx(struct blink_nbr_t *e) {
+  u2_t etx = e->etx + _link_etx(e);
+  return etx > ETX_MAX ? ETX_MAX : etx;
+}
+
+// pick the neighbour with the cheapest path to the sink, but only leave the
+// current parent for a clearly better one
+static void _select_parent(void) {
+  struct blink_nbr_t *cur = _nbr_find(BLINK.parent);
+  if(cur != NULL && cur->hop < BEACON_SLOTS) {
+    // follow our parent's hop and cost
+    BLINK.hop = cur->hop + 1;
+    BLINK.etx = _path_etx(cur);
+  } else {
+    cur = NULL;
+  }
+
+  struct blink_nbr_t *best = NULL;
+  u1_t best_etx = ETX_MAX;
+  for(u1_t i = 0; i < NBR_TABLE_SIZE; i++) {
+    struct blink_nbr_t *e = &BLINK.nbr[i];
+    // our beacon has to go out in a beacon slot after its
+    if(!e->used || e->hop >= BEACON_SLOTS) {
+      continue;
+    }
+    // only closer to the sink than we are: siblings and children may still
+    // advertise a cost they got through us, picking them would be a loop
+    if(cur != NULL && e->hop >= BLINK.hop) {
+      continue;
+    }
+    u1_t etx = _path_etx(e);
+    if(etx < best_etx) {
+      best = e;
+      best_etx = etx;
+    }
+  }
+
+  if(best == NULL || best == cur ||
+     (cur != NULL && best_etx + PARENT_SWITCH_ETX >= BLINK.etx)) {
+    return;
+  }
+
+  debug_str("parent ");
+  debug_uint(BLINK.parent);
+  debug_str(" -> ");
+  debug_uint(best->id);
+  debug_char('\r');
+  debug_char('\n');
+  BLINK.parent = best->id;
+  BLINK.hop = best->hop + 1;
+  _bcn_listen();
+  BLINK.etx = best_etx;
+  BLINK.stats.parent_changes++;
+  _debug_nbrs();
+}
+
+// dump the neighbour table: id, hop, path etx, prr, rssi, snr
+static void _debug_nbrs(void) {
+  for(u1_t i = 0; i < NBR_TABLE_SIZE; i++) {
+    struct blink_nbr_t *e = &BLINK.nbr[i];
+    if(!e->used) {
+      continue;
+    }
+    debug_str("nbr ");
+    debug_uint(e->id);
+    debug_char(' ');
+    debug_hex(e->hop);
+    debug_char(' ');
+    debug_hex(e->etx);
+    debug_char(' ');
+    debug_hex(e->prr);
+    debug_char(' ');
+    debug_hex(e->rssi);
+    debug_char(' ');
+    debug_hex(e->snr);
+    debug_char('\r');
+    debug_char('\n');
+  }
+}
+
 // go to the next slot
 static inline void _next_slot() {
+  BLINK.slots++;
   BLINK.slot++;
+  BLINK.net_ms += BLINK.cfg.slot_ms;
   if(BLINK.slot >= TIME_SLOTS) {
     BLINK.slot = 0;
+    BLINK.epoch++;
+    _apply_config();
   }
   debug_str("slot ");
   debug_hex(BLINK.slot);
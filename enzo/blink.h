@@ -10,75 +10,250 @@
 #ifndef _BLINK_H_
 #define _BLINK_H_
 
-enum { MAX_BEACON_HOPS  = 5  };  // max depth of the network (keep in sync with beacon slots?)
+enum { MAX_BEACON_HOPS  = 5  };  // max number of beacon slots (depth of the network) supported
 enum { MAX_DATA_HOPS    = 5  };  // maximum number of hops for a data packet
-enum { MAX_PAYLOAD_LEN  = 6  };  // bytes - maximum payload for a data packet
 
-enum { TIME_SLOT_ms     = 5000 };  // msec - time slot length
-enum { TIME_SLOTS       = 60   };  // total number of slots
-enum { BEACON_SLOTS     = 5    };  // number of beacon slots
-enum { DATA_SLOTS       = TIME_SLOTS - BEACON_SLOTS };  // number of data slots (time slots - beacon slots)
+/* default frame structure, the root announces the active one in its beacons */
+enum { DEFAULT_TIME_SLOT_ms   = 5000 };  // msec - time slot length
+enum { DEFAULT_TIME_SLOTS     = 60   };  // total number of slots
+enum { DEFAULT_BEACON_SLOTS   = 5    };  // number of beacon slots
+enum { DEFAULT_MAX_DRIFT_ms   = 400  };  // msec - maximum drift between wakeup slots and beacons (TX starts this far into a slot)
+
+#if !defined(BLINK_TX_QUEUE_DEPTH)
+#define BLINK_TX_QUEUE_DEPTH 4       // packets per tx queue class
+#endif
+
+#if !defined(BLINK_DUP_CACHE_SIZE)
+#define BLINK_DUP_CACHE_SIZE 16      // recently forwarded records remembered to drop duplicates
+#endif
+
+#if !defined(BLINK_ROUTE_CACHE_SIZE)
+#define BLINK_ROUTE_CACHE_SIZE 16    // root: nodes with a route kept for the downlink
+#endif
+
+#if !defined(BLINK_BCN_SKIP_MAX)
+#define BLINK_BCN_SKIP_MAX 8         // epochs - longest run of beacon rounds a stable node sleeps through (0: always listen)
+#endif
+
+#if !defined(BLINK_NBR_TABLE_SIZE)
+#define BLINK_NBR_TABLE_SIZE 4       // neighbours tracked for parent selection
+#endif
 
 enum { RX_QUEUE_DEPTH   = 1 };  // maximum number of packets in the rx queue
-enum { TX_QUEUE_DEPTH   = 1 };  // maximum number of packets in the tx queue
+enum { TX_QUEUE_DEPTH   = BLINK_TX_QUEUE_DEPTH };  // maximum number of packets per tx queue class
+enum { NBR_TABLE_SIZE   = BLINK_NBR_TABLE_SIZE };  // maximum number of neighbours
+enum { DUP_CACHE_SIZE   = BLINK_DUP_CACHE_SIZE };  // entries in the duplicate cache
+enum { ROUTE_CACHE_SIZE = BLINK_ROUTE_CACHE_SIZE };  // entries in the root's route cache
 
 enum { CAD_CHECKS         = 3   }; // number of CAD checks to run
-enum { MAX_MISSED_BEACONS = BEACON_SLOTS * 3   }; // maximum number of missed beacon rounds
-enum { MAX_DRIFT_ms       = 400 }; //  msec - maximum drift between wakeup slots and beacons
+enum { SCAN_CAD_SYMS      = 2   }; //  symbols a CAD takes (it must fit in a preamble to detect it)
+enum { SCAN_SWITCH_us     = 1000}; //  usec - CAD done IRQ to the receiver running (run loop, SPI setup, PLL lock)
+enum { SCAN_BACKOFF_MAX   = 4   }; //  a scan sleeps at most 2^SCAN_BACKOFF_MAX epochs between attempts
+enum { SCAN_SLEEP_MAX_s   = 3600}; //  sec  - but never longer than this
+enum { CLOCK_DRIFT_ppm    = 100 }; //  ppm  - worst-case clock drift between two nodes
+enum { DRIFT_SAMPLES      = 8   }; //  parent beacons in the drift estimator window
+enum { DRIFT_MIN_SAMPLES  = 3   }; //  parent beacons before the estimate is applied
+enum { DRIFT_RESIDUAL_ppm = 10  }; //  ppm  - drift left after correcting for the estimate
+enum { DRIFT_UNIT_ms      = 64  }; //  msec - network time unit of the estimator (keeps its sums in range)
+enum { BCN_SKIP_MAX       = BLINK_BCN_SKIP_MAX };
+enum { BCN_STABLE_EPOCHS  = 4   }; //  clean beacon rounds in a row before a node starts skipping
+enum { RX_MARGIN_ms       = 10  }; //  msec - RX window margin for scheduling jitter
+enum { RX_MIN_SYMS        = 6   }; //  symbols needed to detect a preamble
+enum { RX_PEEK_SYMS       = 8   }; //  symbols between looks at the header of a frame being received
+enum { TX_BURST_GAP_ms    = 20  }; //  msec - gap between back-to-back frames in one data slot
+enum { MINISLOT_GUARD_ms  = 20  }; //  msec - guard on either side of a data mini-slot
+enum { ACK_DELAY_ms       = 50  }; //  msec - gap between the end of a data frame and its ACK (covers frame processing)
+enum { ACK_RETRIES        = 3   }; //  default number of retransmissions of an unacknowledged frame
+
+/* link estimation and parent selection */
+enum { ETX_ONE            = 8    }; //  one expected transmission (ETX fixed point unit)
+enum { ETX_MAX            = 0xFF }; //  unreachable
+enum { PARENT_SWITCH_ETX  = 4    }; //  a new parent must beat the current one by this much
+enum { NBR_EWMA_WEIGHT    = 4    }; //  EWMA weight of a new sample is 1/4
+enum { NBR_PRR_INIT       = 0x80 }; //  beacon reception ratio of a newly heard neighbour (of 255)
+enum { NBR_PRR_MIN        = 0x10 }; //  neighbours below this are forgotten
+enum { NBR_SNR_MARGIN_qdB = 10   }; //  quarter dB - SNR above the demodulation floor for a sound link
+
+#if !defined(BLINK_SCHEDULE)
+#define BLINK_SCHEDULE      SCHED_PIPELINE  // hop-ordered data slots by default
+#endif
+
+#if !defined(TRUE)
+#define TRUE                1
+#define FALSE               0
+#endif
+
+#if !defined(BLINK_USE_ACK)
+#define BLINK_USE_ACK       FALSE    // no link-layer ACKs by default
+#endif
 
-enum { AIRTIME_BEACON_us  = 827392 }; // airtime for the beacon (assuming SF12/BW125,CR_4_5,CRC,HDR and 4 bytes)
+#if !defined(BLINK_USE_DOWNLINK)
+#define BLINK_USE_DOWNLINK  FALSE    // no downlink slots by default
+#endif
 
 #if !defined(BLINK_USE_CAD)
-#define BLINK_USE_CAD       FALSE    // don't use CAD by default
+#define BLINK_USE_CAD       FALSE    // listen for beacons and data with an RX window by default
+#endif
+
+#if !defined(BLINK_USE_LPL)
+#define BLINK_USE_LPL       FALSE    // data slots listen with an RX window by default
+#endif
+
+#if !defined(BLINK_USE_RX_PEEK)
+#define BLINK_USE_RX_PEEK   FALSE    // receive every data frame in full by default
+#endif
+
+#if !defined(BLINK_LPL_PREAMBLE)
+#define BLINK_LPL_PREAMBLE(rps)  blink_lpl_preamble(rps)  // data frame preamble (symbols) with LPL
 #endif
 
-#define AIRTIME_BEACON_ticks us2osticks(AIRTIME_BEACON_us)
-#define TIME_SLOT_ticks      ms2osticks(TIME_SLOT_ms)
+// active frame structure
+#define TIME_SLOTS           (BLINK.cfg.slots)
+#define BEACON_SLOTS         (BLINK.cfg.beacon_slots)
+#define DATA_SLOTS           (TIME_SLOTS - BEACON_SLOTS)
+#define TIME_SLOT_ticks      ms2osticks(BLINK.cfg.slot_ms)
+#define SLOT_GUARD_ticks     ms2osticks(BLINK.cfg.drift_ms)
+#define MAX_MISSED_BEACONS   (BEACON_SLOTS * 3)  // maximum number of missed beacon rounds
 
 enum _event_t {
   EVENT_SYNC = 1,        // got sync
   EVENT_LOST_SYNC,       // lost sync
   EVENT_RXCOMPLETE,      // received data ready
-  EVENT_TXCOMPLETE       // transmit data done
+  EVENT_TXCOMPLETE,      // transmit data done (acknowledged if ACKs are used)
+  EVENT_TXFAILED         // transmit data not acknowledged after all retries
 };
 typedef enum _event_t event_t;
 
 enum _packet_type_t {
   BEACON = 0x00,
   DATA   = 0x01,
+  ACK    = 0x02,
+  DOWN   = 0x03,
 };
 typedef enum _packet_type_t packet_type_t;
 
 /* packet definitions */
 struct _header_t {
-  packet_type_t type : 4;
-  u1_t          hop  : 4;
-  u1_t          dest;
+  packet_type_t type   : 3;
+  u1_t          ackreq : 1;  // data: sender waits for an ACK
+  u1_t          hop    : 4;
+  u2_t          dest;
+  u2_t          src;
 } __attribute__((packed));
 typedef struct _header_t header_t;
 
-struct _footer_t {
- u2_t           trace; 
+/* frame structure */
+struct blink_cfg_t {
+  u2_t          slot_ms;      // msec - time slot length
+  u2_t          drift_ms;     // msec - maximum drift between wakeup slots and beacons
+  u1_t          slots;        // total number of slots
+  u1_t          beacon_slots; // number of beacon slots, at most MAX_BEACON_HOPS
+  u1_t          sched;        // data slot schedule
+  u1_t          ack;          // data frames are acknowledged
+  u1_t          down;         // downlink mini-slots at the end of the data slots
 } __attribute__((packed));
-typedef struct _footer_t footer_t;
 
-struct _beacon_msg_t {
+/* frame structure in force from the start of an epoch */
+struct _beacon_cfg_t {
+  u2_t          epoch;
+  struct blink_cfg_t cfg;
+} __attribute__((packed));
+typedef struct _beacon_cfg_t beacon_cfg_t;
+
+/* beacon: header followed by type-length-value fields, unknown types are skipped */
+struct _tlv_t {
+  u1_t          type;
+  u1_t          len;          // length of the value that follows
+} __attribute__((packed));
+typedef struct _tlv_t tlv_t;
+
+enum {
+  BCN_EPOCH      = 0x01,  // u2_t - current epoch (required)
+  BCN_TIME       = 0x02,  // u4_t - msec - network time at the start of the beacon (required)
+  BCN_ETX        = 0x03,  // u1_t - sender's path ETX to the sink (required)
+  BCN_DIGEST     = 0x04,  // u2_t - digest of the active frame structure
+  BCN_CONFIG     = 0x05,  // beacon_cfg_t - latest frame structure announced by the root
+};
+
+enum { BCN_CONFIG_EVERY = 8 };  // epochs - the announced frame structure is repeated this often
+
+/* beacon contents */
+struct _beacon_t {
   header_t      header;
-  // empty
-  footer_t      footer;
+  u1_t          fields;       // TLV types present, bit (1 << type)
+  u2_t          epoch;
+  u4_t          time;
+  u1_t          etx;
+  u2_t          digest;
+  beacon_cfg_t  next;
+};
+typedef struct _beacon_t beacon_t;
+
+/* data record: one payload from one source
+ * the path records how the record travelled: every relay at hop h puts the
+ * index of the child it got the record from in its child table in
+ * hop h's PATH_SHIFT bits, which is enough for each relay to route back */
+struct _record_hdr_t {
+  u1_t          len;    // payload length
+  u1_t          age;    // slots spent queued on the way to the sink
+  u1_t          seq;    // sequence number, per source
+  u2_t          src;    // source id (destination id for downlink records)
+  u2_t          path;   // child index per relay hop, 0 if not relayed there
+} __attribute__((packed));
+typedef struct _record_hdr_t record_hdr_t;
+
+/* on air a record is packed: its length byte, which also flags the fields
+ * that are present, seq and age, then src unless it is the frame sender's
+ * id and path unless it is 0, then the payload */
+enum {
+  REC_LEN_MASK   = 0x3F,  // payload length
+  REC_SRC        = 0x40,  // src follows
+  REC_PATH       = 0x80,  // path follows
+};
+enum { REC_HDR_MIN = 3 };  // bytes - packed header of a record with neither
+
+// bytes - maximum payload for a data record (a single record fills the radio frame,
+// however it is packed; at most REC_LEN_MASK)
+enum { MAX_PAYLOAD_LEN = MAX_LEN_FRAME - sizeof(header_t) - sizeof(record_hdr_t) };
+
+struct _record_t {
+  record_hdr_t  hdr;
+  u1_t          payload[MAX_PAYLOAD_LEN];
 } __attribute__((packed));
-typedef struct _beacon_msg_t beacon_msg_t;
+typedef struct _record_t record_t;
 
+/* data frame: header followed by one or more packed records
+ * downlink frame: header followed by a single packed record, its path holds the route
+ *   as recorded by the destination's last uplink record */
 struct _data_msg_t {
   header_t      header;
-  u1_t          payload[MAX_PAYLOAD_LEN];
-  footer_t      footer;
+  u1_t          records[MAX_LEN_FRAME - sizeof(header_t)];
 } __attribute__((packed));
 typedef struct _data_msg_t data_msg_t;
 
 enum {
   DEST_ROOT      = 0x00,
-  DEST_BROADCAST = 0xff,
+  DEST_BROADCAST = 0xffff,
+};
+
+/* data slot schedules */
+enum {
+  SCHED_NODEID   = 0,   // a source and a forwarding slot per node id
+  SCHED_PIPELINE = 1,   // a slot per node id and hop, deepest hop first
+};
+
+/* tx queue classes, in order of priority */
+enum {
+  TXQ_FORWARD    = 0,   // frames relayed towards the sink
+  TXQ_LOCAL      = 1,   // frames handed to blink_tx
+  TXQ_DOWN       = 2,   // downlink frames, sent in the downlink mini-slots only
+  TXQ_CLASSES
+};
+
+/* tx queue drop policies, applied when a class is full */
+enum {
+  TXQ_DROP_NEWEST = 0,  // refuse the incoming frame
+  TXQ_DROP_OLDEST = 1,  // evict the frame at the head of the queue
 };
 
 enum {
@@ -86,6 +261,7 @@ enum {
   PEND_BEACON_TX = 0x01,
   PEND_DATA_TX   = 0x02,
   PEND_DATA_RX   = 0x04,
+  PEND_ACK_TX    = 0x08,
 };
 
 /* Operating modes */
@@ -99,6 +275,106 @@ enum { OP_NONE   = 0x0000,
        OP_RXDATA = 0x0040, // RX user data
        OP_ROOT   = 0x0080, // Root node
        OP_NODE   = 0x0100, // Regular node
+       OP_TXACK  = 0x0200, // TX acknowledgement
+       OP_RXACK  = 0x0400, // RX acknowledgement
+       OP_TXDOWN = 0x0800, // TX downlink data
+};
+
+#define PATH_MASK   (0xF)
+#define PATH_SHIFT  (4)
+#define PATH_MAX    (16 / PATH_SHIFT)  // relay hops a path can record (at least MAX_BEACON_HOPS - 1)
+
+enum { PATH_NOROUTE     = PATH_MASK };      // relayed, but the child table was full (no way back)
+enum { CHILD_TABLE_SIZE = PATH_MASK - 1 };  // children a relay can route back to
+
+#define ROOT_ID (0)
+
+// data schedule layout, in mini-slots counted from the first data slot
+//   SCHED_NODEID:   a source half, then a forwarding half
+//   SCHED_PIPELINE: a group for every hop, deepest hop first
+// followed, if enabled, by a downlink mini-slot per hop at the end of the data slots
+// (the halves or groups take all other mini-slots of the data slots; a node
+// owns the mini-slot a hash of its id and vslot_salt picks in each of its
+// own, and picks another one when it hears a node send in it, see
+// slot_shared; faster data rates fit more mini-slots in a data slot, which
+// makes collisions rarer but idle listening longer, in the pipeline nodes
+// only listen in their children's group)
+enum { VSLOT_NONE    = 0xFFFF };  // no mini-slot of the data schedule
+
+/* blink statistics */
+struct blink_stats_t {
+  u4_t bcn_rx_slots;  // beacon slots with the receiver on
+  u4_t bcn_rx_ticks;  // receiver on-time in beacon slots
+  u4_t data_rx_slots; // data slots with the receiver on
+  u4_t data_rx_ticks; // receiver on-time in data slots
+  u4_t data_idle_slots; // data mini-slots listened to with nothing sent
+  u4_t data_idle_ticks; // receiver on-time in those, the cost of an idle slot
+  u4_t rx_aborted;    // data frames cut short once their header showed they're not for us
+  u4_t rx_ticks_max;  // longest receiver on-time in a single slot
+  u4_t txq_queued[TXQ_CLASSES];  // records accepted per tx queue class
+  u4_t txq_dropped[TXQ_CLASSES]; // records dropped per tx queue class
+  u1_t txq_max[TXQ_CLASSES];     // tx queue occupancy high-water mark
+  u4_t tx_frames;     // data frames sent
+  u4_t tx_records;    // records sent in those frames
+  u4_t tx_bytes;      // payload bytes sent in those frames
+  u4_t tx_ticks;      // airtime of those frames
+  u4_t rx_frames;     // data frames delivered to the sink (root only)
+  u4_t rx_records;    // records delivered to the sink
+  u4_t rx_bytes;      // payload bytes delivered to the sink
+  u4_t rx_ticks;      // airtime of the delivered frames
+  u4_t rx_collisions; // data frames lost to CRC errors
+  u4_t rx_duplicates; // records received again (retransmitted or relayed twice) and dropped
+  u4_t slot_shared;   // data frames heard from other nodes in our own source mini-slot (each moves us)
+  u4_t child_overflow;// records from children that didn't fit the child table (no route back)
+  u4_t tx_retries;    // retransmissions of unacknowledged frames
+  u4_t tx_failed;     // frames given up after all retries
+  u4_t parent_changes;// parent switches
+  u4_t sync_beacons;  // beacons received in the slot we expected them in
+  u4_t sync_err_sum;  // sum of their offsets from the expected time (ticks)
+  u4_t sync_err_max;  // worst offset (ticks)
+  u4_t bcn_skipped;   // beacon rounds slept through
+  u4_t scan_syncs;    // scans for the network that ended in sync
+  u4_t scan_ticks;    // sum of their time to sync
+  u4_t scan_ticks_max;// longest time to sync
+  u4_t scan_on_ticks; // sum of their radio on-time (CAD and RX), the energy to sync
+  u4_t scan_on_max;   // largest radio on-time of a single scan
+  u4_t scan_cads;     // CADs run while scanning
+  u4_t epoch_skips;   // epochs we missed entirely, told by the beacon's epoch
+  u4_t cfg_mismatch;  // beacons announcing a different active frame structure than ours
+  u4_t down_noroute;  // downlink records refused for lack of a recent route (root only)
+  u4_t down_fwd;      // downlink records relayed
+  u4_t down_rx;       // downlink records delivered to us
+  u4_t down_age;      // sum of their latencies (slots)
+  u1_t down_age_max;  // worst latency (slots)
+  // per source hop (index hop - 1), records delivered to the sink (root only)
+  u4_t hop_records[MAX_BEACON_HOPS + 1];  // delivered records
+  u4_t hop_in_epoch[MAX_BEACON_HOPS + 1]; // delivered within one epoch
+  u4_t hop_age[MAX_BEACON_HOPS + 1];      // sum of latencies (slots)
+  u1_t hop_age_max[MAX_BEACON_HOPS + 1];  // worst latency (slots)
+};
+
+/* neighbour table entry, filled from received beacons */
+struct blink_nbr_t {
+  u1_t used;          // entry in use
+  u2_t id;            // node id
+  u1_t hop;           // advertised hop
+  u1_t etx;           // advertised path ETX
+  u1_t prr;           // beacon reception ratio EWMA (of 255), updated per epoch
+  u1_t heard;         // beacon heard this epoch
+  s2_t rssi;          // dBm - RSSI EWMA
+  s2_t snr;           // quarter dB - SNR EWMA
+  u4_t link_tx;       // data frames sent to it asking for an ACK
+  u4_t link_ack;      // data frames it acknowledged
+};
+
+/* root: route back to a node, from its last uplink record */
+struct blink_route_t {
+  u1_t used;          // entry in use
+  u2_t dest;          // node id
+  u2_t via;           // first hop
+  u2_t path;          // path of the record
+  u2_t epoch;         // epoch it was learned in
+  u4_t sent;          // downlink records sent to it
 };
 
 /* blink control struct */
@@ -106,10 +382,46 @@ struct blink_t {
   u2_t opmode;        // current operating mode
   u1_t slot;          // current time slot
   u1_t hop;           // our hop (distance) to the sink
+  u2_t parent;        // id of the node we send data to
   u1_t pending;       // pending bits
-  u1_t nodeid;        // id of this node
+  u2_t nodeid;        // id of this node
   u1_t missed_beacons;// number of missed beacons
-  u1_t hop_updated;   // 0 if hop wasn't updated this epoch, 1 otherwise
+  u1_t etx;           // our path ETX to the sink through the parent
+  ostime_t slot_time;   // start of the current slot
+  ostime_t beacon_time; // start of the last received beacon
+  ostime_t sync_err;    // offset of the last beacon from its expected time
+  ostime_t anchor;      // start of the slot we last synced on
+  u4_t     anchor_slots;// slot count of that slot
+  s2_t     drift_ppm;   // estimated clock drift against the root (local clock fast if > 0)
+  u1_t     bcn_skip;    // beacon rounds left to sleep through
+  u1_t     bcn_run;     // length of the current run of skipped rounds
+  u1_t     bcn_streak;  // clean beacon rounds in a row
+  ostime_t scan_start;  // start of the current scan for the network
+  ostime_t scan_end;    // end of the current scan attempt
+  u4_t     scan_on;     // radio on-time of the current scan
+  u1_t     scan_backoff;// failed scan attempts (backoff exponent)
+  ostime_t rx_time;     // start of the scheduled RX window
+  u1_t     rx_syms;     // length of the scheduled RX window in symbols
+  u1_t     tx_local;    // number of local records in the frame on air
+  u1_t     txq_policy[TXQ_CLASSES]; // drop policy per tx queue class
+  u1_t     period;      // reporting period in epochs
+  u1_t     max_retries; // retransmissions of an unacknowledged frame
+  u1_t     seq;         // sequence number of our next record
+  u4_t     slots;       // slots elapsed since start
+  u1_t     minislots;   // mini-slots per data slot at the current data rate
+  u2_t     vslots;      // mini-slots the data schedule assigns
+  u1_t     vslot_salt;  // picks our mini-slots, changed when one turns out to be shared
+  u1_t     minislot;    // current mini-slot
+  ostime_t minislot_ticks; // mini-slot length
+  u2_t     epoch;       // current epoch
+  u4_t     net_ms;      // msec - network time at the start of the current slot
+  struct blink_cfg_t cfg; // active frame structure
+  beacon_cfg_t next;    // frame structure to switch to at next.epoch
+  struct blink_nbr_t nbr[NBR_TABLE_SIZE]; // neighbours heard, for parent selection
+  u2_t     children[CHILD_TABLE_SIZE];    // relays: children that sent us records, by path index - 1
+  u2_t     child_epoch[CHILD_TABLE_SIZE]; // relays: epoch each child was last heard
+  struct blink_route_t routes[ROUTE_CACHE_SIZE]; // root: routes for the downlink
+  struct blink_stats_t stats;
 };
 extern struct blink_t BLINK;
 
@@ -119,13 +431,23 @@ extern void on_event(event_t ev);
 void blink_init(void);
 void blink_reset(void);
 void blink_start_sync(void);
-void blink_tx(u1_t *buffer, size_t n);
-void blink_rx(u1_t *buffer, size_t n);
+u1_t blink_tx(u1_t *buffer, size_t n);
+u1_t blink_txq_len(u1_t cls);
+u1_t blink_tx_down(u2_t dest, u1_t *buffer, size_t n);
+void blink_set_period(u1_t epochs);
+ostime_t blink_next_report(void);
+size_t blink_rx(u1_t *buffer, size_t n);
+/* root: the new frame structure's epoch must be at least CONFIG_LEAD_EPOCHS
+ * away, time for it to reach the deepest hop through relays that sleep
+ * through up to BCN_SKIP_MAX beacon rounds (47 epochs, about 4 h, with the
+ * defaults) */
+#define CONFIG_LEAD_EPOCHS   (BEACON_SLOTS * (BCN_SKIP_MAX + 1) + 2)
+u1_t blink_set_config(const struct blink_cfg_t *cfg, u2_t epoch);
+u2_t blink_slot_ms(rps_t rps, u2_t drift_ms);
+u2_t blink_lpl_preamble(rps_t rps);
+u4_t blink_network_time(void);
 
-#define TRACE_MASK  (0x7)
-#define TRACE_SHIFT (3)
-#define TRACE_MAX   (16 / TRACE_SHIFT)
-
-#define ROOT_ID (0)
+enum { MAX_PERIOD    = 64 };  // epochs - longest reporting period
+enum { ROUTE_TIMEOUT = 16 };  // epochs - routes learned longer ago are stale
 
 #endif /* end of include guard: _BLINK_H_ */
@@ -14,6 +14,7 @@ extern inline int   getIh    (rps_t params);
 extern inline rps_t setIh    (rps_t params, int ih);
 extern inline rps_t makeRps  (sf_t sf, bw_t bw, cr_t cr, int ih, int nocrc);
 extern inline int   sameSfBw (rps_t r1, rps_t r2);
+extern inline int   getLdro  (rps_t params);
 
 
 void ENZO_init() {
@@ -30,4 +31,52 @@ void ENZO_reset() {
   ENZO.rps = makeRps(SF7, BW125, CR_4_5, 0, 0);
   ENZO.freq       = 868000000; // Hz
   ENZO.txpow      = 2;         // dBm
+  ENZO.preamble   = STD_PREAMBLE_LEN;
+  ENZO.rxpreamble = STD_PREAMBLE_LEN;
+}
+
+// Time-on-air in microseconds of a frame with plen payload bytes
+// (see SX1272 datasheet, 4.1.1.7)
+u4_t calcAirTimeUs (rps_t rps, u1_t plen) {
+    return calcAirTimePreUs(rps, plen, STD_PREAMBLE_LEN);
+}
+
+// Time-on-air in ticks of a frame with plen payload bytes
+ostime_t calcAirTime (rps_t rps, u1_t plen) {
+    return us2osticksRound(calcAirTimeUs(rps, plen));
+}
+
+// Time-on-air in microseconds of a frame with plen payload bytes sent
+// with a preamble of the given number of symbols
+u4_t calcAirTimePreUs (rps_t rps, u1_t plen, u2_t preamble) {
+    u1_t sf = getSf(rps);  // 0=FSK, 1..6 = SF7..12
+    if( sf == FSK ) {
+        return (plen+/*preamble*/5+/*syncword*/3+/*len*/1+/*crc*/2) * /*bits/byte*/8
+            * (1000000 / /*bit/s*/50000);
+    }
+    int sfx = 4*(sf+(7-SF7));
+    int q = sfx - (getLdro(rps) ? 8 : 0);
+    int tmp = 8*plen - sfx + 28 + (getNocrc(rps)?0:16) - (getIh(rps)?20:0);
+    if( tmp > 0 ) {
+        tmp = (tmp + q - 1) / q;
+        tmp *= getCr(rps)+5;
+        tmp += 8;
+    } else {
+        tmp = 8;
+    }
+    // symbols x4, preamble adds 4.25 symbols for sync word and SFD
+    tmp = (tmp<<2) + 4*preamble + 17;
+    // symbol times are whole microseconds for all SF/BW
+    return ((u4_t)tmp * calcSymTimeUs(rps)) >> 2;
+}
+
+// Time-on-air in ticks of a frame sent with a preamble of the given length
+ostime_t calcAirTimePre (rps_t rps, u1_t plen, u2_t preamble) {
+    return us2osticksRound(calcAirTimePreUs(rps, plen, preamble));
+}
+
+// Duration of one LoRa symbol in microseconds
+u4_t calcSymTimeUs (rps_t rps) {
+    ASSERT(getSf(rps) != FSK);
+    return ((u4_t)1000 << (getSf(rps)+(7-SF7))) / (125 << getBw(rps));
 }
@@ -25,6 +25,8 @@ struct enzo_t {
   u1_t       cad;                         // CAD detected (0=no carrier detected, 1=carrier detected)
   rps_t      rps;                         // Radio Parameter Set of Bandwidth/Spreading Factor/Coding Rate
   u1_t       rxsyms;                      // RX timeout in symbols
+  u2_t       preamble;                    // TX preamble length in symbols
+  u2_t       rxpreamble;                  // longest preamble (symbols) expected in RX
   s1_t       txpow;                       // TX output power in dBm
   osjob_t    osjob;                       // callback for handled IRQs
   u1_t       dataLen;                     // 0 no data or zero length data, >0 byte cout of data
@@ -35,4 +37,10 @@ DECLARE_ENZO;
 void ENZO_init      (void);
 void ENZO_reset     (void);
 
+ostime_t calcAirTime   (rps_t rps, u1_t plen);
+u4_t     calcAirTimeUs (rps_t rps, u1_t plen);
+ostime_t calcAirTimePre   (rps_t rps, u1_t plen, u2_t preamble);
+u4_t     calcAirTimePreUs (rps_t rps, u1_t plen, u2_t preamble);
+u4_t     calcSymTimeUs (rps_t rps);
+
 #endif // _enzo_h_
@@ -34,5 +34,17 @@ inline rps_t makeRps (sf_t sf, bw_t bw, cr_t cr, int ih, int nocrc) {
 #define MAKERPS(sf,bw,cr,ih,nocrc) ((rps_t)((sf) | ((bw)<<3) | ((cr)<<5) | ((nocrc)?(1<<7):0) | ((ih&0xFF)<<8)))
 // Two frames with params r1/r2 would interfere on air: same SFx + BWx
 inline int sameSfBw(rps_t r1, rps_t r2) { return ((r1^r2)&0x1F) == 0; }
+// Low data rate optimization (mandated for SF11 and SF12 at BW125)
+inline int getLdro  (rps_t params)         { return getSf(params) >= SF11 && getBw(params) == BW125; }
+
+// Constant time-on-air in microseconds, for fixed frame sizes (LoRa only)
+//   sf/bw/cr as SFx/BWx/CR_4_x, ih/nocrc as in makeRps, pl payload bytes
+#define AIRTIME_SYMTIME_us(sf,bw) ((1000L << ((sf)+6)) / (125 << (bw)))
+#define AIRTIME_LDRO(sf,bw)       ((sf) >= SF11 && (bw) == BW125)
+#define AIRTIME_PLBITS(sf,ih,nocrc,pl) (8*(pl) - 4*((sf)+6) + 28 + ((nocrc)?0:16) - ((ih)?20:0))
+#define AIRTIME_PLSYMS(sf,bw,cr,ih,nocrc,pl) (8 + (AIRTIME_PLBITS(sf,ih,nocrc,pl) > 0 ? \
+        ((AIRTIME_PLBITS(sf,ih,nocrc,pl) + 4*((sf)+6-2*AIRTIME_LDRO(sf,bw)) - 1) / (4*((sf)+6-2*AIRTIME_LDRO(sf,bw)))) * ((cr)+5) : 0))
+#define AIRTIME_us(sf,bw,cr,ih,nocrc,pl) \
+        (((4*STD_PREAMBLE_LEN + 17 + 4*AIRTIME_PLSYMS(sf,bw,cr,ih,nocrc,pl)) * AIRTIME_SYMTIME_us(sf,bw)) / 4)
 
 #endif // _enzobase_h_
@@ -39,6 +39,18 @@ void hal_pin_rst (u1_t val);
  */
 u1_t hal_spi (u1_t outval);
 
+/*
+ * perform SPI burst transaction with radio (DMA where available).
+ *   - write 'len' bytes from 'tx' (zeros if NULL)
+ *   - store 'len' bytes read into 'rx' (discarded if NULL)
+ *   - no 'done_cb': return when complete, CPU sleeps meanwhile (other
+ *     IRQs are served unless the caller has disabled them)
+ *   - with 'done_cb': return immediately, callback is invoked on IRQ
+ *   - caller keeps NSS asserted until completion
+ */
+typedef void (*hal_spicb_t) (void);
+void hal_spi_xfer (const u1_t* tx, u1_t* rx, u2_t len, hal_spicb_t done_cb);
+
 /*
  * disable all CPU interrupts.
  *   - might be invoked nested 
@@ -51,11 +63,35 @@ void hal_disableIRQs (void);
  */
 void hal_enableIRQs (void);
 
+/*
+ * return worst-case IRQ handler duration and IRQ-disabled time (CPU cycles).
+ *   - only measured when built with CFG_irq_stats, 0 otherwise
+ */
+void hal_irqStats (u4_t* isrmax, u4_t* irqoffmax);
+
 /*
  * put system and CPU in low-power mode, sleep until interrupt.
+ *   - returns on radio DIO IRQ, SPI burst completion, armed timer or
+ *     hal_wakeup(); any other IRQ (timer overflows included) is served
+ *     and sleep resumes
+ *   - may enter stop mode if the armed timer is far enough ahead
  */
 void hal_sleep (void);
 
+/*
+ * make hal_sleep() return to the run loop.
+ *   - for IRQ handlers outside the HAL that leave work for the run loop
+ *   - called by os_setCallback() and os_setTimedCallback()
+ */
+void hal_wakeup (void);
+
+/*
+ * allow (1) or inhibit (0) stop mode in hal_sleep().
+ *   - inhibited while radio operations need exact IRQ timestamps
+ *   - no-op unless built with CFG_stop_mode
+ */
+void hal_allowStop (u1_t allow);
+
 /*
  * return 32-bit system time in ticks.
  */
@@ -69,7 +105,7 @@ void hal_waitUntil (u4_t time);
 /*
  * check and rewind timer for target time.
  *   - return 1 if target time is close
- *   - otherwise rewind timer for target time or full period and return 0
+ *   - otherwise arm timer for target time (any distance) and return 0
  */
 u1_t hal_checkTimer (u4_t targettime);
 
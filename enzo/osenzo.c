@@ -13,8 +13,11 @@
 
 // RUNTIME STATE
 static struct {
-    osjob_t* scheduledjobs;
-    osjob_t* runnablejobs;
+    osjob_t* heap[OS_MAX_TIMEDJOBS]; // timed jobs, binary min-heap on deadline
+    u2_t     njobs;                  // number of timed jobs in heap
+    u2_t     seq;                    // insertion counter for timed jobs
+    osjob_t* runnablejobs;           // run queue head
+    osjob_t* runnabletail;           // run queue tail
 } OS;
 
 void os_init () {
@@ -28,57 +31,144 @@ ostime_t os_getTime () {
     return hal_ticks();
 }
 
-static u1_t unlinkjob (osjob_t** pnext, osjob_t* job) {
-    for( ; *pnext; pnext = &((*pnext)->next)) {
-        if(*pnext == job) { // unlink
-            *pnext = job->next;
-            return 1;
+// deadline ordering of two timed jobs (cmp diff, not abs!),
+// jobs with equal deadlines run in the order they were scheduled
+static inline int earlier (osjob_t* a, osjob_t* b) {
+    ostime_t d = a->deadline - b->deadline;
+    return d < 0 || (d == 0 && (s2_t)(a->qseq - b->qseq) < 0);
+}
+
+// place job into heap slot
+static inline void heapset (u2_t i, osjob_t* job) {
+    OS.heap[i] = job;
+    job->qidx = i;
+}
+
+// move job at slot i up towards the root until heap order is restored
+static void siftup (u2_t i) {
+    osjob_t* job = OS.heap[i];
+    while(i > 0) {
+        u2_t parent = (i-1) >> 1;
+        if(!earlier(job, OS.heap[parent])) {
+            break;
         }
+        heapset(i, OS.heap[parent]);
+        i = parent;
     }
-    return 0;
+    heapset(i, job);
+}
+
+// move job at slot i down towards the leaves until heap order is restored
+static void siftdown (u2_t i) {
+    osjob_t* job = OS.heap[i];
+    while(1) {
+        uint child = 2*(uint)i + 1;
+        if(child >= OS.njobs) {
+            break;
+        }
+        if(child+1 < OS.njobs && earlier(OS.heap[child+1], OS.heap[child])) {
+            child++;
+        }
+        if(!earlier(OS.heap[child], job)) {
+            break;
+        }
+        heapset(i, OS.heap[child]);
+        i = child;
+    }
+    heapset(i, job);
+}
+
+// remove timed job from heap
+static void heapremove (osjob_t* job) {
+    u2_t i = job->qidx;
+    osjob_t* last = OS.heap[--OS.njobs];
+    if(last != job) {
+        heapset(i, last);
+        if(i > 0 && earlier(last, OS.heap[(i-1) >> 1])) {
+            siftup(i);
+        } else {
+            siftdown(i);
+        }
+    }
+    job->qstate = OSJOB_IDLE;
+}
+
+// remove runnable job from run queue
+static void rununlink (osjob_t* job) {
+    if(job->prev) {
+        job->prev->next = job->next;
+    } else {
+        OS.runnablejobs = job->next;
+    }
+    if(job->next) {
+        job->next->prev = job->prev;
+    } else {
+        OS.runnabletail = job->prev;
+    }
+    job->qstate = OSJOB_IDLE;
 }
 
 // clear scheduled job
 void os_clearCallback (osjob_t* job) {
     hal_disableIRQs();
-    unlinkjob(&OS.scheduledjobs, job) || unlinkjob(&OS.runnablejobs, job);
+    // the queue state of a job that was never queued is undefined,
+    // so only trust it when it is confirmed by the queue itself
+    if(job->qstate == OSJOB_SCHEDULED) {
+        if(job->qidx < OS.njobs && OS.heap[job->qidx] == job) {
+            heapremove(job);
+        }
+    } else if(job->qstate == OSJOB_RUNNABLE) {
+        // (its links may be garbage as well, look for it in the run queue)
+        for(osjob_t* j = OS.runnablejobs; j; j = j->next) {
+            if(j == job) {
+                rununlink(job);
+                break;
+            }
+        }
+    }
     hal_enableIRQs();
 }
 
 // schedule immediately runnable job
 void os_setCallback (osjob_t* job, osjobcb_t cb) {
-    osjob_t** pnext;
     hal_disableIRQs();
     // remove if job was already queued
     os_clearCallback(job);
     // fill-in job
     job->func = cb;
     job->next = NULL;
+    job->prev = OS.runnabletail;
+    job->qstate = OSJOB_RUNNABLE;
     // add to end of run queue
-    for(pnext=&OS.runnablejobs; *pnext; pnext=&((*pnext)->next));
-    *pnext = job;
+    if(OS.runnabletail) {
+        OS.runnabletail->next = job;
+    } else {
+        OS.runnablejobs = job;
+    }
+    OS.runnabletail = job;
+    // (in case we're called from an IRQ handler)
+    hal_wakeup();
     hal_enableIRQs();
 }
 
 // schedule timed job
 void os_setTimedCallback (osjob_t* job, ostime_t time, osjobcb_t cb) {
-    osjob_t** pnext;
     hal_disableIRQs();
     // remove if job was already queued
     os_clearCallback(job);
+    ASSERT(OS.njobs < OS_MAX_TIMEDJOBS);
     // fill-in job
     job->deadline = time;
     job->func = cb;
     job->next = NULL;
+    job->prev = NULL;
+    job->qstate = OSJOB_SCHEDULED;
+    job->qseq = OS.seq++;
     // insert into schedule
-    for(pnext=&OS.scheduledjobs; *pnext; pnext=&((*pnext)->next)) {
-        if((*pnext)->deadline - time > 0) { // (cmp diff, not abs!)
-            // enqueue before next element and stop
-            job->next = *pnext;
-            break;
-        }
-    }
-    *pnext = job;
+    heapset(OS.njobs++, job);
+    siftup(job->qidx);
+    // (the timer may have to be armed earlier)
+    hal_wakeup();
     hal_enableIRQs();
 }
 
@@ -86,19 +176,24 @@ void os_setTimedCallback (osjob_t* job, ostime_t time, osjobcb_t cb) {
 void os_runloop () {
     while(1) {
         osjob_t* j = NULL;
+        u1_t irq = 0;
         hal_disableIRQs();
-        // check for runnable jobs
-        if(OS.runnablejobs) {
+        // check for deferred radio interrupts
+        if(radio_irq_pending()) {
+            irq = 1;
+        } else if(OS.runnablejobs) { // check for runnable jobs
             j = OS.runnablejobs;
-            OS.runnablejobs = j->next;
-        } else if(OS.scheduledjobs && hal_checkTimer(OS.scheduledjobs->deadline)) { // check for expired timed jobs
-            j = OS.scheduledjobs;
-            OS.scheduledjobs = j->next;
+            rununlink(j);
+        } else if(OS.njobs && hal_checkTimer(OS.heap[0]->deadline)) { // check for expired timed jobs
+            j = OS.heap[0];
+            heapremove(j);
         } else { // nothing pending
             hal_sleep(); // wake by irq (timer already restarted)
         }
         hal_enableIRQs();
-        if(j) { // run job callback
+        if(irq) { // radio SPI work (with IRQs enabled)
+            radio_irq_process();
+        } else if(j) { // run job callback
             j->func(j);
         }
     }
@@ -55,6 +55,11 @@ u1_t radio_rand1 (void);
 
 void radio_init (void);
 void radio_irq_handler (u1_t dio);
+u1_t radio_irq_pending (void);
+void radio_irq_process (void);
+void radio_spiStats (u4_t* ops, u4_t* spiops, u4_t* spisaved);
+u1_t radio_rx_peek (u1_t len);
+s2_t radio_rssi2dBm (u1_t rssi);
 void os_init (void);
 void os_runloop (void);
 
@@ -90,12 +95,26 @@ typedef s4_t  ostime_t;
 #endif
 
 
+#ifndef OS_MAX_TIMEDJOBS
+#define OS_MAX_TIMEDJOBS 32
+#elif OS_MAX_TIMEDJOBS < 1 || OS_MAX_TIMEDJOBS > 32767
+// (jobs scheduled together must stay within half the osjob_t.qseq range)
+#error Illegal OS_MAX_TIMEDJOBS - must be in range [1:32767].
+#endif
+
+// Job queue state (osjob_t.qstate)
+enum { OSJOB_IDLE=0, OSJOB_RUNNABLE=1, OSJOB_SCHEDULED=2 };
+
 struct osjob_t;  // fwd decl.
 typedef void (*osjobcb_t) (struct osjob_t*);
 struct osjob_t {
-    struct osjob_t* next;
+    struct osjob_t* next;   // run queue successor
+    struct osjob_t* prev;   // run queue predecessor
     ostime_t deadline;
     osjobcb_t  func;
+    u1_t qstate;            // OSJOB_IDLE, OSJOB_RUNNABLE or OSJOB_SCHEDULED
+    u2_t qidx;              // position in timer heap (if scheduled)
+    u2_t qseq;              // insertion order (orders jobs with equal deadlines)
 };
 TYPEDEF_xref2osjob_t;
 
@@ -253,21 +253,93 @@
 // (initialized by radio_init(), used by radio_rand1())
 static u1_t randbuf[16];
 
+// DIO EVENT RING
+// (single producer radio_irq_handler() on IRQ, single consumer radio_irq_process())
+enum { IRQ_RING_SIZE = 8 }; // must be a power of two
+static struct {
+    struct {
+        ostime_t time;  // time of DIO edge
+        u1_t     dio;   // DIO line
+    } ev[IRQ_RING_SIZE];
+    volatile u1_t head; // next slot to write (producer)
+    volatile u1_t tail; // next slot to read (consumer)
+    u1_t overflow;      // number of dropped events
+} irqring;
+
 
 #ifdef CFG_sx1276_radio
 #define LNA_RX_GAIN (0x20|0x1)
+#define RSSI_OFFSET 157 // packet RSSI offset (dBm), high frequency port
 #elif CFG_sx1272_radio
 #define LNA_RX_GAIN (0x20|0x03)
+#define RSSI_OFFSET 139 // packet RSSI offset (dBm)
 #else
 #error Missing CFG_sx1272_radio/CFG_sx1276_radio
 #endif
 
 
+// REGISTER SHADOW
+// (registers keep their value in sleep mode, so configuration registers are
+// only written when they change; the shadow is dropped on a modem switch)
+enum { FRF_CACHE_SIZE = 4 }; // frequencies with a cached RegFrf value
+
+static struct {
+    u1_t val[0x80];       // last value written to / read from register
+    u1_t valid[0x80/8];   // bitmap of valid entries in val
+    struct {
+        u4_t freq;        // frequency
+        u4_t frf;         // RegFrf value for freq (0 = none)
+    } frf[FRF_CACHE_SIZE];// RegFrf values of the last few frequencies used
+    u1_t frfnext;         // next frf entry to replace
+} shadow;
+
+// SPI statistics
+static struct {
+    u4_t ops;             // radio operations started (TX/RX/CAD)
+    u4_t spiops;          // SPI transactions issued
+    u4_t spisaved;        // SPI transactions saved by the shadow
+} stats;
+
+#define SHADOW_VALID(a)      (shadow.valid[(a)>>3] & (1<<((a)&7)))
+#define SHADOW_SET(a,v)      do { shadow.val[(a)] = (v); shadow.valid[(a)>>3] |= (1<<((a)&7)); } while(0)
+#define SHADOW_INVALIDATE(a) do { shadow.valid[(a)>>3] &= ~(1<<((a)&7)); } while(0)
+
+// forget all registers except RegOpMode
+static void shadowReset () {
+    u1_t op = SHADOW_VALID(RegOpMode);
+    os_clearMem(shadow.valid, sizeof(shadow.valid));
+    if(op) {
+        SHADOW_SET(RegOpMode, shadow.val[RegOpMode]);
+    }
+}
+
 static void writeReg (u1_t addr, u1_t data ) {
     hal_pin_nss(0);
     hal_spi(addr | 0x80);
     hal_spi(data);
     hal_pin_nss(1);
+    stats.spiops++;
+    if(addr == RegOpMode) {
+        // switching modems exposes a different register set
+        if( SHADOW_VALID(RegOpMode) && ((shadow.val[RegOpMode] ^ data) & OPMODE_LORA) ) {
+            shadowReset();
+        }
+        SHADOW_SET(RegOpMode, data);
+    } else {
+        SHADOW_INVALIDATE(addr);
+    }
+}
+
+// write consecutive registers in one transaction (too short for a DMA burst)
+static void writeRegs (u1_t addr, const u1_t* data, u1_t len) {
+    hal_pin_nss(0);
+    hal_spi(addr | 0x80);
+    for(u1_t i=0; i<len; i++) {
+        hal_spi(data[i]);
+        SHADOW_SET(addr+i, data[i]);
+    }
+    hal_pin_nss(1);
+    stats.spiops++;
 }
 
 static u1_t readReg (u1_t addr) {
@@ -275,29 +347,50 @@ static u1_t readReg (u1_t addr) {
     hal_spi(addr & 0x7F);
     u1_t val = hal_spi(0x00);
     hal_pin_nss(1);
+    stats.spiops++;
+    return val;
+}
+
+// write configuration register unless it already holds the value
+static void writeCfg (u1_t addr, u1_t data) {
+    if( SHADOW_VALID(addr) && shadow.val[addr] == data ) {
+        stats.spisaved++;
+        return;
+    }
+    writeReg(addr, data);
+    SHADOW_SET(addr, data);
+}
+
+// read configuration register from shadow if possible
+static u1_t readCfg (u1_t addr) {
+    if( SHADOW_VALID(addr) ) {
+        stats.spisaved++;
+        return shadow.val[addr];
+    }
+    u1_t val = readReg(addr);
+    SHADOW_SET(addr, val);
     return val;
 }
 
 static void writeBuf (u1_t addr, xref2u1_t buf, u1_t len) {
+    stats.spiops++;
     hal_pin_nss(0);
     hal_spi(addr | 0x80);
-    for (u1_t i=0; i<len; i++) {
-        hal_spi(buf[i]);
-    }
+    hal_spi_xfer(buf, NULL, len, NULL);
     hal_pin_nss(1);
 }
 
 static void readBuf (u1_t addr, xref2u1_t buf, u1_t len) {
+    stats.spiops++;
     hal_pin_nss(0);
     hal_spi(addr & 0x7F);
-    for (u1_t i=0; i<len; i++) {
-        buf[i] = hal_spi(0x00);
-    }
+    hal_spi_xfer(NULL, buf, len, NULL);
     hal_pin_nss(1);
 }
 
+// (mode bits change autonomously, but the remaining bits are ours)
 static void opmode (u1_t mode) {
-    writeReg(RegOpMode, (readReg(RegOpMode) & ~OPMODE_MASK) | mode);
+    writeReg(RegOpMode, (readCfg(RegOpMode) & ~OPMODE_MASK) | mode);
 }
 
 static void opmodeLora() {
@@ -344,19 +437,19 @@ static void configLoraModem () {
             writeReg(LORARegPayloadLength, getIh(ENZO.rps)); // required length
         }
         // set ModemConfig1
-        writeReg(LORARegModemConfig1, mc1);
+        writeCfg(LORARegModemConfig1, mc1);
 
         mc2 = (SX1272_MC2_SF7 + ((sf-1)<<4));
         if (getNocrc(ENZO.rps) == 0) {
             mc2 |= SX1276_MC2_RX_PAYLOAD_CRCON;
         }
-        writeReg(LORARegModemConfig2, mc2);
+        writeCfg(LORARegModemConfig2, mc2);
         
         mc3 = SX1276_MC3_AGCAUTO;
-        if ((sf == SF11 || sf == SF12) && getBw(ENZO.rps) == BW125) {
+        if (getLdro(ENZO.rps)) {
             mc3 |= SX1276_MC3_LOW_DATA_RATE_OPTIMIZE;
         }
-        writeReg(LORARegModemConfig3, mc3);
+        writeCfg(LORARegModemConfig3, mc3);
 #elif CFG_sx1272_radio
         u1_t mc1 = (getBw(ENZO.rps)<<6);
 
@@ -367,7 +460,7 @@ static void configLoraModem () {
         case CR_4_8: mc1 |= SX1272_MC1_CR_4_8; break;
         }
         
-        if ((sf == SF11 || sf == SF12) && getBw(ENZO.rps) == BW125) {
+        if (getLdro(ENZO.rps)) {
             mc1 |= SX1272_MC1_LOW_DATA_RATE_OPTIMIZE;
         }
         
@@ -380,21 +473,45 @@ static void configLoraModem () {
             writeReg(LORARegPayloadLength, getIh(ENZO.rps)); // required length
         }
         // set ModemConfig1
-        writeReg(LORARegModemConfig1, mc1);
+        writeCfg(LORARegModemConfig1, mc1);
         
         // set ModemConfig2 (sf, AgcAutoOn=1 SymbTimeoutHi=00)
-        writeReg(LORARegModemConfig2, (SX1272_MC2_SF7 + ((sf-1)<<4)) | 0x04);
+        writeCfg(LORARegModemConfig2, (SX1272_MC2_SF7 + ((sf-1)<<4)) | 0x04);
 #else
 #error Missing CFG_sx1272_radio/CFG_sx1276_radio
 #endif /* CFG_sx1272_radio */
 }
 
+// RegFrf value for the current frequency
+static u4_t frfValue () {
+    for(u1_t i=0; i<FRF_CACHE_SIZE; i++) {
+        if( shadow.frf[i].frf != 0 && shadow.frf[i].freq == ENZO.freq ) {
+            return shadow.frf[i].frf;
+        }
+    }
+    // FQ = (FRF * 32 Mhz) / (2 ^ 19)
+    u1_t i = shadow.frfnext;
+    shadow.frfnext = (i + 1) % FRF_CACHE_SIZE;
+    shadow.frf[i].frf  = ((u8_t)ENZO.freq << 19) / 32000000;
+    shadow.frf[i].freq = ENZO.freq;
+    return shadow.frf[i].frf;
+}
+
 static void configChannel () {
-    // set frequency: FQ = (FRF * 32 Mhz) / (2 ^ 19)
-    u8_t frf = ((u8_t)ENZO.freq << 19) / 32000000;
-    writeReg(RegFrfMsb, (u1_t)(frf>>16));
-    writeReg(RegFrfMid, (u1_t)(frf>> 8));
-    writeReg(RegFrfLsb, (u1_t)(frf>> 0));
+    u4_t frf = frfValue();
+    u1_t val[3] = { (u1_t)(frf>>16), (u1_t)(frf>> 8), (u1_t)(frf>> 0) };
+    u1_t first = 0;
+    while( first < 3 && SHADOW_VALID(RegFrfMsb+first) && shadow.val[RegFrfMsb+first] == val[first] ) {
+        first++;
+    }
+    if( first == 3 ) {
+        stats.spisaved += 3;
+        return;
+    }
+    // a new frequency only takes effect with the write of RegFrfLsb, so
+    // write from the first changed byte up to it in one burst
+    writeRegs(RegFrfMsb+first, val+first, 3-first);
+    stats.spisaved += 2;  // (one transaction instead of three)
 }
 
 
@@ -409,8 +526,8 @@ static void configPower () {
         pw = 2;
     }
     // check board type for BOOST pin
-    writeReg(RegPaConfig, (u1_t)(0x80|(pw&0xf)));
-    writeReg(RegPaDac, readReg(RegPaDac)|0x4);
+    writeCfg(RegPaConfig, (u1_t)(0x80|(pw&0xf)));
+    writeCfg(RegPaDac, readCfg(RegPaDac)|0x4);
 
 #elif CFG_sx1272_radio
     // set PA config (2-17 dBm using PA_BOOST)
@@ -420,7 +537,7 @@ static void configPower () {
     } else if(pw < 2) {
         pw = 2;
     }
-    writeReg(RegPaConfig, (u1_t)(0x80|(pw-2)));
+    writeCfg(RegPaConfig, (u1_t)(0x80|(pw-2)));
 #else
 #error Missing CFG_sx1272_radio/CFG_sx1276_radio
 #endif /* CFG_sx1272_radio */
@@ -482,20 +599,23 @@ static void txlora () {
     // configure frequency
     configChannel();
     // configure output power
-    writeReg(RegPaRamp, (readReg(RegPaRamp) & 0xF0) | 0x08); // set PA ramp-up time 50 uSec
+    writeCfg(RegPaRamp, (readCfg(RegPaRamp) & 0xF0) | 0x08); // set PA ramp-up time 50 uSec
     configPower();
     // set sync word
-    writeReg(LORARegSyncWord, LORA_MAC_PREAMBLE);
+    writeCfg(LORARegSyncWord, LORA_MAC_PREAMBLE);
+    // set preamble length
+    writeCfg(LORARegPreambleMsb, (u1_t)(ENZO.preamble >> 8));
+    writeCfg(LORARegPreambleLsb, (u1_t)ENZO.preamble);
     
     // set the IRQ mapping DIO0=TxDone DIO1=NOP DIO2=NOP
-    writeReg(RegDioMapping1, MAP_DIO0_LORA_TXDONE|MAP_DIO1_LORA_NOP|MAP_DIO2_LORA_NOP);
+    writeCfg(RegDioMapping1, MAP_DIO0_LORA_TXDONE|MAP_DIO1_LORA_NOP|MAP_DIO2_LORA_NOP);
     // clear all radio IRQ flags
     writeReg(LORARegIrqFlags, 0xFF);
     // mask all IRQs but TxDone
-    writeReg(LORARegIrqFlagsMask, ~IRQ_LORA_TXDONE_MASK);
+    writeCfg(LORARegIrqFlagsMask, (u1_t)~IRQ_LORA_TXDONE_MASK);
 
     // initialize the payload size and address pointers    
-    writeReg(LORARegFifoTxBaseAddr, 0x00);
+    writeCfg(LORARegFifoTxBaseAddr, 0x00);
     writeReg(LORARegFifoAddrPtr, 0x00);
     writeReg(LORARegPayloadLength, ENZO.dataLen);
        
@@ -538,8 +658,8 @@ static void rxlora (u1_t rxmode) {
     opmode(OPMODE_STANDBY);
     // don't use MAC settings at startup
     if(rxmode == RXMODE_RSSI) { // use fixed settings for rssi scan
-        writeReg(LORARegModemConfig1, RXLORA_RXMODE_RSSI_REG_MODEM_CONFIG1);
-        writeReg(LORARegModemConfig2, RXLORA_RXMODE_RSSI_REG_MODEM_CONFIG2);
+        writeCfg(LORARegModemConfig1, RXLORA_RXMODE_RSSI_REG_MODEM_CONFIG1);
+        writeCfg(LORARegModemConfig2, RXLORA_RXMODE_RSSI_REG_MODEM_CONFIG2);
     } else { // single or continuous rx mode
         // configure LoRa modem (cfg1, cfg2)
         configLoraModem();
@@ -547,22 +667,25 @@ static void rxlora (u1_t rxmode) {
         configChannel();
     }
     // errata; optimized rx spurious response, bit 7 of 0x31 should be set to 0
-    writeReg(LORARegDetectOptimize, readReg(LORARegDetectOptimize) & 0x7F);
+    writeCfg(LORARegDetectOptimize, readCfg(LORARegDetectOptimize) & 0x7F);
     // set LNA gain
-    writeReg(RegLna, LNA_RX_GAIN); 
+    writeCfg(RegLna, LNA_RX_GAIN); 
     // set max payload size
-    writeReg(LORARegPayloadMaxLength, 64);
+    writeCfg(LORARegPayloadMaxLength, 64);
     // set symbol timeout (for single rx)
-    writeReg(LORARegSymbTimeoutLsb, ENZO.rxsyms);
+    writeCfg(LORARegSymbTimeoutLsb, ENZO.rxsyms);
     // set sync word
-    writeReg(LORARegSyncWord, LORA_MAC_PREAMBLE);
+    writeCfg(LORARegSyncWord, LORA_MAC_PREAMBLE);
+    // set preamble length (it must cover the longest one sent to us)
+    writeCfg(LORARegPreambleMsb, (u1_t)(ENZO.rxpreamble >> 8));
+    writeCfg(LORARegPreambleLsb, (u1_t)ENZO.rxpreamble);
     
     // configure DIO mapping DIO0=RxDone DIO1=RxTout DIO2=NOP
-    writeReg(RegDioMapping1, MAP_DIO0_LORA_RXDONE|MAP_DIO1_LORA_RXTOUT|MAP_DIO2_LORA_NOP);
+    writeCfg(RegDioMapping1, MAP_DIO0_LORA_RXDONE|MAP_DIO1_LORA_RXTOUT|MAP_DIO2_LORA_NOP);
     // clear all radio IRQ flags
     writeReg(LORARegIrqFlags, 0xFF);
     // enable required radio IRQs
-    writeReg(LORARegIrqFlagsMask, ~rxlorairqmask[rxmode]);
+    writeCfg(LORARegIrqFlagsMask, (u1_t)~rxlorairqmask[rxmode]);
 
     // enable antenna switch for RX
     hal_pin_rxtx(0);
@@ -589,7 +712,7 @@ static void rxfsk (u1_t rxmode) {
     configChannel();
     // set LNA gain
     //writeReg(RegLna, 0x20|0x03); // max gain, boost enable
-    writeReg(RegLna, LNA_RX_GAIN);
+    writeCfg(RegLna, LNA_RX_GAIN);
     // configure receiver
     writeReg(FSKRegRxConfig, 0x1E); // AFC auto, AGC, trigger on preamble?!?
     // set receiver bandwidth
@@ -713,6 +836,15 @@ u1_t radio_rand1 () {
     return v;
 }
 
+// return SPI transaction counters
+void radio_spiStats (u4_t* ops, u4_t* spiops, u4_t* spisaved) {
+    hal_disableIRQs();
+    *ops      = stats.ops;
+    *spiops   = stats.spiops;
+    *spisaved = stats.spisaved;
+    hal_enableIRQs();
+}
+
 u1_t radio_rssi () {
     hal_disableIRQs();
     u1_t r = readReg(LORARegRssiValue);
@@ -720,6 +852,38 @@ u1_t radio_rssi () {
     return r;
 }
 
+// return packet RSSI in dBm for a PktRssiValue register value (ENZO.rssi)
+s2_t radio_rssi2dBm (u1_t rssi) {
+    return (s2_t)rssi - RSSI_OFFSET;
+}
+
+// copy the first len bytes of the LoRa frame being received to ENZO.frame
+// (return 1 once its header is valid and they have arrived, 0 otherwise)
+u1_t radio_rx_peek (u1_t len) {
+    u1_t ok = 0;
+    hal_disableIRQs();
+    // (from the chip, it leaves RX_SINGLE on its own when the frame is done)
+    u1_t op = readReg(RegOpMode);
+    SHADOW_SET(RegOpMode, op);
+    if( (op & (OPMODE_LORA|OPMODE_MASK)) == (OPMODE_LORA|OPMODE_RX_SINGLE) ) {
+        u1_t flags = readReg(LORARegIrqFlags);
+        // (a completed frame is left to the RxDone event)
+        if( (flags & (IRQ_LORA_HEADER_MASK|IRQ_LORA_RXDONE_MASK)) == IRQ_LORA_HEADER_MASK ) {
+            u1_t base = readCfg(LORARegFifoRxBaseAddr);
+            // RxByteAddr is the address of the last byte written by the
+            // modem per the datasheet, one past it as seen on some parts;
+            // waiting for one byte more than len is safe either way
+            if( (u1_t)(readReg(LORARegFifoRxByteAddr) - base) > len ) {
+                writeReg(LORARegFifoAddrPtr, base);
+                readBuf(RegFifo, ENZO.frame, len);
+                ok = 1;
+            }
+        }
+    }
+    hal_enableIRQs();
+    return ok;
+}
+
 static const u2_t LORA_RXDONE_FIXUP[] = {
     [FSK]  =     us2osticks(0), // (   0 ticks)
     [SF7]  =     us2osticks(0), // (   0 ticks)
@@ -731,10 +895,27 @@ static const u2_t LORA_RXDONE_FIXUP[] = {
 };
 
 // called by hal ext IRQ handler
-// (radio goes to stanby mode after tx/rx operations)
+// (only timestamp the DIO edge and defer the SPI work to the run loop)
 void radio_irq_handler (u1_t dio) {
-    ostime_t now = os_getTime();
-    if( (readReg(RegOpMode) & OPMODE_LORA) != 0) { // LORA modem
+    u1_t h = irqring.head;
+    if( (u1_t)(h - irqring.tail) >= IRQ_RING_SIZE ) {
+        irqring.overflow++;
+        return;
+    }
+    irqring.ev[h & (IRQ_RING_SIZE-1)].time = os_getTime();
+    irqring.ev[h & (IRQ_RING_SIZE-1)].dio  = dio;
+    irqring.head = h + 1; // publish
+}
+
+// return 1 if DIO events are waiting for radio_irq_process()
+u1_t radio_irq_pending () {
+    return irqring.head != irqring.tail;
+}
+
+// handle one DIO event
+// (radio goes to stanby mode after tx/rx operations)
+static void irqevent (u1_t dio, ostime_t now) {
+    if( (readCfg(RegOpMode) & OPMODE_LORA) != 0) { // LORA modem
         u1_t flags = readReg(LORARegIrqFlags);
         if( flags & IRQ_LORA_TXDONE_MASK ) {
             // save exact tx time
@@ -746,7 +927,7 @@ void radio_irq_handler (u1_t dio) {
             }
             ENZO.rxtime = now;
             // read the PDU and inform the MAC that we received something
-            ENZO.dataLen = (readReg(LORARegModemConfig1) & SX1272_MC1_IMPLICIT_HEADER_MODE_ON) ?
+            ENZO.dataLen = (readCfg(LORARegModemConfig1) & SX1272_MC1_IMPLICIT_HEADER_MODE_ON) ?
                 readReg(LORARegPayloadLength) : readReg(LORARegRxNbBytes);
             // set FIFO read address pointer
             writeReg(LORARegFifoAddrPtr, readReg(LORARegFifoRxCurrentAddr)); 
@@ -770,7 +951,7 @@ void radio_irq_handler (u1_t dio) {
           ENZO.dataLen = 0;
         }
         // mask all radio IRQs
-        writeReg(LORARegIrqFlagsMask, 0xFF);
+        writeCfg(LORARegIrqFlagsMask, 0xFF);
         // clear radio IRQ flags
         writeReg(LORARegIrqFlags, 0xFF);
     } else { // FSK modem
@@ -798,10 +979,20 @@ void radio_irq_handler (u1_t dio) {
     }
     // go from stanby to sleep
     opmode(OPMODE_SLEEP);
+    hal_allowStop(1);
     // run os job (use preset func ptr)
     os_setCallback(&ENZO.osjob, ENZO.osjob.func);
 }
 
+// called by run loop to process deferred DIO events
+void radio_irq_process () {
+    while( radio_irq_pending() ) {
+        u1_t t = irqring.tail;
+        irqevent(irqring.ev[t & (IRQ_RING_SIZE-1)].dio, irqring.ev[t & (IRQ_RING_SIZE-1)].time);
+        irqring.tail = t + 1; // release slot
+    }
+}
+
 static void startcad() {
   ASSERT((readReg(RegOpMode) & OPMODE_MASK) == OPMODE_SLEEP);
   ASSERT(getSf(ENZO.rps) != FSK);
@@ -815,19 +1006,19 @@ static void startcad() {
   configChannel();
 
   // errata; optimized rx spurious response, bit 7 of 0x31 should be set to 0
-  writeReg(LORARegDetectOptimize, readReg(LORARegDetectOptimize) & 0x7F);
+  writeCfg(LORARegDetectOptimize, readCfg(LORARegDetectOptimize) & 0x7F);
   // set LNA gain
-  writeReg(RegLna, LNA_RX_GAIN); 
+  writeCfg(RegLna, LNA_RX_GAIN); 
 
   // set sync word
-  writeReg(LORARegSyncWord, LORA_MAC_PREAMBLE);
+  writeCfg(LORARegSyncWord, LORA_MAC_PREAMBLE);
 
   // configure DIO mapping DIO0=CadDone DIO1=CadDetected DIO2=NOP
-  writeReg(RegDioMapping1, MAP_DIO0_LORA_CDDONE|MAP_DIO1_LORA_CDDETD|MAP_DIO2_LORA_NOP);
+  writeCfg(RegDioMapping1, MAP_DIO0_LORA_CDDONE|MAP_DIO1_LORA_CDDETD|MAP_DIO2_LORA_NOP);
   // clear all radio IRQ flags
   writeReg(LORARegIrqFlags, 0xFF);
   // enable required radio IRQs
-  writeReg(LORARegIrqFlagsMask, ~(IRQ_LORA_CDDONE_MASK|IRQ_LORA_CDDETD_MASK));
+  writeCfg(LORARegIrqFlagsMask, (u1_t)~(IRQ_LORA_CDDONE_MASK|IRQ_LORA_CDDETD_MASK));
 
   // enable antenna switch for RX
   hal_pin_rxtx(0);
@@ -840,10 +1031,17 @@ static void startcad() {
 
 void os_radio (u1_t mode) {
     hal_disableIRQs();
+    // keep IRQ timestamps exact while the radio is active
+    hal_allowStop(mode == RADIO_RST);
+    if(mode != RADIO_RST) {
+        stats.ops++;
+    }
     switch (mode) {
       case RADIO_RST:
         // put radio to sleep
         opmode(OPMODE_SLEEP);
+        // discard DIO events of the aborted operation
+        irqring.tail = irqring.head;
         break;
 
       case RADIO_TX:
@@ -20,27 +20,21 @@ static void initfunc(osjob_t *job);
 
 static osjob_t _report_job;
 
+#define REPORT_LEAD_ticks ms2osticks(100)
+
 static u4_t _counter;
-static u1_t tx;
 
 static const u1_t* eventnames[] = {
   [EVENT_SYNC]      = (u1_t*)"SYNC",
   [EVENT_LOST_SYNC] = (u1_t*)"SYNC_LOST",
   [EVENT_RXCOMPLETE]= (u1_t*)"RXCOMPLETE",
   [EVENT_TXCOMPLETE]= (u1_t*)"TXCOMPLETE",
+  [EVENT_TXFAILED]  = (u1_t*)"TXFAILED",
 };
 
-ostime_t next_report_time() {
-  // calculate when the next epoch starts
-  ostime_t time_till_next_epoch = (TIME_SLOTS - BLINK.slot) * TIME_SLOT_ticks;
-  // calculate time offset of the data slots relative to the epoch
-  ostime_t data_slot_time_offset = BEACON_SLOTS * TIME_SLOT_ticks;
-  // we want to transmit once per epoch in a random data time slot
-  u1_t tx_time_slot = radio_rand1() % DATA_SLOTS;
-  // calculate time slot in time offset
-  ostime_t tx_time = tx_time_slot * TIME_SLOT_ticks;
-  // next report is start of the epoch + time offset
-  return time_till_next_epoch + data_slot_time_offset + tx_time;
+// queue the next reading a bit ahead of our data slot
+static void schedule_report(void) {
+  os_setTimedCallback(&_report_job, blink_next_report() - REPORT_LEAD_ticks, FUNC_ADDR(reportfunc));
 }
 
 void on_event(event_t ev) {
@@ -52,7 +46,7 @@ void on_event(event_t ev) {
   switch(ev) {
     case EVENT_SYNC:
       debug_str("start report\r\n");
-      os_setTimedCallback(&_report_job, os_getTime() + (NODE_ID * TIME_SLOT_ticks), FUNC_ADDR(reportfunc));
+      schedule_report();
       break;
     case EVENT_LOST_SYNC:
       debug_str("stop report\r\n");
@@ -62,13 +56,9 @@ void on_event(event_t ev) {
       // nop
       break;
     case EVENT_TXCOMPLETE:
-      if(tx == 1) {
-        debug_str("set next report\r\n");
-        os_setTimedCallback(&_report_job, os_getTime() + next_report_time(), FUNC_ADDR(reportfunc));
-        tx = 0;
-      } else {
-        debug_str("forwarding\r\n");
-      }
+    case EVENT_TXFAILED:
+      debug_str("set next report\r\n");
+      schedule_report();
       break;
     default:
       // nop
@@ -86,7 +76,6 @@ static void reportfunc(osjob_t *job) {
   data[3] = (u1_t)(0xff & (_counter >> 8));
   data[4] = (u1_t)(0xff & (_counter >> 0));
   blink_tx((u1_t*)&data, SIZEOFEXPR(data));
-  tx = 1;
 }
 
 static void initfunc(osjob_t* job) {
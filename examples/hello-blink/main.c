@@ -23,9 +23,8 @@ void on_event(event_t ev) {
       break;
     case EVENT_RXCOMPLETE:
       debug_str("rx complete\r\n");
-      u1_t payload[MAX_LEN_PAYLOAD];
-      blink_rx(payload, MAX_LEN_PAYLOAD);
-      debug_buf(payload, MAX_LEN_PAYLOAD);
+      u1_t payload[MAX_PAYLOAD_LEN];
+      debug_buf(payload, blink_rx(payload, MAX_PAYLOAD_LEN));
       break;
     case EVENT_TXCOMPLETE:
       debug_str("tx complete\r\n");
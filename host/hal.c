@@ -0,0 +1,290 @@
+/*
+ * host HAL
+ * Runs the radio driver on Linux against a simulated SX127x register file,
+ * so its SPI call pattern can be tested and timed without hardware.
+ *
+ * Time is simulated: it only moves on with SPI traffic (at HOST_SPI_HZ)
+ * and when the driver waits or the run loop sleeps. The radio model is a
+ * register file with the FIFO behind RegFifo; it doesn't modulate, tests
+ * fill in what a reception would leave and raise the DIO line. Sleep
+ * periods are counted, optionally cut at every 16-bit timer overflow.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "enzo.h"
+#include "host.h"
+
+// registers the model gives a meaning
+#define RegFifo               0x00
+#define RegOpMode             0x01
+#define LORARegFifoAddrPtr    0x0D
+#define LORARegIrqFlags       0x12
+#define LORARegRssiWideband   0x2C
+#define RegVersion            0x42
+
+#define OPMODE_LORA           0x80
+#define OPMODE_MASK           0x07
+#define OPMODE_SLEEP          0x00
+
+enum { SPI_BYTE_NS = 8 * 1000000000ull / HOST_SPI_HZ };
+enum { SPI_DMA_MIN = 4 }; // shorter bursts are polled (as on stm32)
+
+struct host_spi_t host_spi;
+struct host_sleep_t host_sleep;
+
+// HAL state
+static struct {
+    int irqlevel;
+    u8_t ns;        // simulated time
+    u4_t target;    // armed timer deadline
+    u1_t armed;     // target is valid
+    u1_t wakeup;    // IRQ requiring the run loop has occurred
+    u1_t nss;       // NSS pin
+    u1_t rxtx;      // antenna switch (0=rx, 1=tx)
+} HAL;
+
+// simulated radio
+static struct {
+    u1_t reg[0x80];
+    u1_t fifo[256];
+    u1_t fskptr;    // FIFO pointer of the FSK modem
+    u1_t addr;      // register of the current transaction
+    u1_t write;     // current transaction writes
+    u1_t first;     // next byte is the address byte
+} RADIO;
+
+static void radio_reset () {
+    memset(&RADIO, 0x00, sizeof(RADIO));
+#ifdef CFG_sx1276_radio
+    RADIO.reg[RegVersion] = 0x12;
+#else
+    RADIO.reg[RegVersion] = 0x22;
+#endif
+}
+
+static u1_t* fifo_byte () {
+    if(RADIO.reg[RegOpMode] & OPMODE_LORA) {
+        return &RADIO.fifo[RADIO.reg[LORARegFifoAddrPtr]++];
+    }
+    return &RADIO.fifo[RADIO.fskptr++];
+}
+
+static void radio_write (u1_t addr, u1_t val) {
+    if(addr == LORARegIrqFlags && (RADIO.reg[RegOpMode] & OPMODE_LORA)) {
+        RADIO.reg[addr] &= ~val; // write 1 to clear
+        return;
+    }
+    if(addr == RegOpMode && (val & OPMODE_MASK) == OPMODE_SLEEP) {
+        RADIO.fskptr = 0;
+    }
+    RADIO.reg[addr] = val;
+}
+
+static u1_t radio_read (u1_t addr) {
+    if(addr == LORARegRssiWideband) {
+        return rand(); // noise
+    }
+    return RADIO.reg[addr];
+}
+
+// clock one byte through the radio's SPI slave
+static u1_t radio_spi (u1_t out) {
+    u1_t in = 0x00;
+    if(RADIO.first) {
+        RADIO.first = 0;
+        RADIO.addr  = out & 0x7F;
+        RADIO.write = out & 0x80;
+    } else if(RADIO.addr == RegFifo) {
+        u1_t* b = fifo_byte();
+        if(RADIO.write) {
+            *b = out;
+        } else {
+            in = *b;
+        }
+    } else {
+        // bursts auto-increment the register address
+        if(RADIO.write) {
+            radio_write(RADIO.addr, out);
+        } else {
+            in = radio_read(RADIO.addr);
+        }
+        RADIO.addr = (RADIO.addr + 1) & 0x7F;
+    }
+    host_spi.bytes++;
+    host_spi.bus_ns += SPI_BYTE_NS;
+    HAL.ns += SPI_BYTE_NS;
+    return in;
+}
+
+// -----------------------------------------------------------------------------
+// I/O
+
+void hal_pin_rxtx (u1_t val) {
+    ASSERT(val == 1 || val == 0);
+    HAL.rxtx = val;
+}
+
+void hal_pin_nss (u1_t val) {
+    if(val == 0 && HAL.nss) {
+        host_spi.nss++;
+        RADIO.first = 1;
+    }
+    HAL.nss = val;
+}
+
+void hal_pin_rst (u1_t val) {
+    if(val == 0 || val == 1) {
+        radio_reset();
+    }
+}
+
+void host_dio (u1_t dio) {
+    HAL.wakeup = 1;
+    radio_irq_handler(dio);
+}
+
+u1_t host_reg (u1_t addr) {
+    return RADIO.reg[addr & 0x7F];
+}
+
+void host_set_reg (u1_t addr, u1_t val) {
+    RADIO.reg[addr & 0x7F] = val;
+}
+
+u1_t* host_fifo () {
+    return RADIO.fifo;
+}
+
+// -----------------------------------------------------------------------------
+// SPI
+
+u1_t hal_spi (u1_t out) {
+    ASSERT(HAL.nss == 0);
+    host_spi.polled++;
+    host_spi.cpu_ns += SPI_BYTE_NS;
+    return radio_spi(out);
+}
+
+void hal_spi_xfer (const u1_t* tx, u1_t* rx, u2_t len, hal_spicb_t done_cb) {
+    ASSERT(HAL.nss == 0);
+    host_spi.bursts++;
+    host_spi.burst_bytes += len;
+    if(len < SPI_DMA_MIN) {
+        host_spi.cpu_ns += len * SPI_BYTE_NS;
+    }
+    // (otherwise moved by the DMA, the CPU is free meanwhile)
+    for(u2_t i=0; i<len; i++) {
+        u1_t v = radio_spi(tx ? tx[i] : 0x00);
+        if(rx) {
+            rx[i] = v;
+        }
+    }
+    if(done_cb) {
+        host_spi.async++;
+        HAL.wakeup = 1;
+        done_cb();
+    }
+}
+
+void host_spi_reset () {
+    memset(&host_spi, 0x00, sizeof(host_spi));
+}
+
+// -----------------------------------------------------------------------------
+// TIME
+
+u4_t hal_ticks () {
+    return (u4_t)(HAL.ns * OSTICKS_PER_SEC / 1000000000ull);
+}
+
+u8_t host_time_ns () {
+    return HAL.ns;
+}
+
+// move simulated time on to the given tick
+static void advance (u4_t time) {
+    s4_t d = time - hal_ticks();
+    if(d > 0) {
+        HAL.ns += ((u8_t)d * 1000000000ull + OSTICKS_PER_SEC - 1) / OSTICKS_PER_SEC;
+    }
+}
+
+void hal_waitUntil (u4_t time) {
+    advance(time);
+}
+
+u1_t hal_checkTimer (u4_t time) {
+    HAL.wakeup = 0;
+    if((s4_t)(time - hal_ticks()) < 5) {
+        HAL.armed = 0;
+        return 1;
+    }
+    HAL.target = time;
+    HAL.armed = 1;
+    return 0;
+}
+
+// -----------------------------------------------------------------------------
+// IRQ
+
+void hal_disableIRQs () {
+    HAL.irqlevel++;
+}
+
+void hal_enableIRQs () {
+    ASSERT(HAL.irqlevel > 0);
+    HAL.irqlevel--;
+}
+
+void hal_irqStats (u4_t* isrmax, u4_t* irqoffmax) {
+    *isrmax = *irqoffmax = 0;
+}
+
+void hal_wakeup () {
+    HAL.wakeup = 1;
+}
+
+void hal_sleep () {
+    // nothing else can raise an IRQ, sleep until the armed timer
+    HAL.wakeup = 0;
+    ASSERT(HAL.armed);
+    host_sleep.sleeps++;
+    host_sleep.wakeups++;
+    if(host_sleep.tick16) {
+        // the overflow IRQ returns to the run loop, which re-arms the timer
+        u4_t next = (hal_ticks() | 0xFFFF) + 1;
+        if((s4_t)(HAL.target - next) > 0) {
+            advance(next);
+            return;
+        }
+    }
+    advance(HAL.target);
+    HAL.armed = 0;
+    HAL.wakeup = 1;
+}
+
+void host_sleep_reset () {
+    u1_t tick16 = host_sleep.tick16;
+    memset(&host_sleep, 0x00, sizeof(host_sleep));
+    host_sleep.tick16 = tick16;
+}
+
+void hal_allowStop (u1_t allow) {
+}
+
+// -----------------------------------------------------------------------------
+
+void hal_init () {
+    memset(&HAL, 0x00, sizeof(HAL));
+    HAL.nss = 1;
+    radio_reset();
+    host_spi_reset();
+    host_sleep_reset();
+}
+
+void hal_failed (u1_t *file, u4_t line) {
+    fprintf(stderr, "ASSERT %s:%u\n", file, line);
+    exit(1);
+}
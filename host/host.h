@@ -0,0 +1,51 @@
+/*
+ * host HAL
+ * Runs the radio driver on Linux against a simulated SX127x register file,
+ * so its SPI call pattern can be tested and timed without hardware.
+ *
+ */
+
+#ifndef _host_h_
+#define _host_h_
+
+#if !defined(HOST_SPI_HZ)
+#define HOST_SPI_HZ 8000000     // SPI clock (PCLK/2), sets the simulated bus time
+#endif
+
+/* SPI traffic since host_spi_reset() */
+struct host_spi_t {
+  u4_t nss;           // transactions (NSS low periods)
+  u4_t bytes;         // bytes clocked over the bus
+  u4_t polled;        // of those, by hal_spi() with the CPU spinning
+  u4_t bursts;        // hal_spi_xfer() bursts
+  u4_t burst_bytes;   // bytes moved by those
+  u4_t async;         // bursts completed through their callback
+  u8_t bus_ns;        // nsec - time the bus was busy
+  u8_t cpu_ns;        // nsec - of that, time the CPU spun on it
+};
+extern struct host_spi_t host_spi;
+
+void  host_spi_reset (void);
+
+/* sleep periods since host_sleep_reset() */
+struct host_sleep_t {
+  u1_t tick16;        // set: wake at every 16-bit timer overflow, as the HAL did before it went tickless
+  u4_t sleeps;        // hal_sleep() calls
+  u4_t wakeups;       // IRQs that ended a low-power period
+};
+extern struct host_sleep_t host_sleep;
+
+void  host_sleep_reset (void);
+
+/* simulated radio: register file and FIFO */
+u1_t  host_reg       (u1_t addr);
+void  host_set_reg   (u1_t addr, u1_t val);
+u1_t* host_fifo      (void);
+
+/* raise a radio DIO line, as the EXTI handler would */
+void  host_dio       (u1_t dio);
+
+/* nsec - simulated time since hal_init() */
+u8_t  host_time_ns   (void);
+
+#endif // _host_h_
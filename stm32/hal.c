@@ -91,8 +91,29 @@ static const u1_t inputpins[]  = { DIO0_PORT, DIO0_PIN, DIO1_PORT, DIO1_PIN, DIO
 static struct {
     int irqlevel;
     u4_t ticks;
+    u4_t target;    // armed timer deadline
+    u1_t armed;     // target is valid
+    u1_t wakeup;    // IRQ requiring the run loop has occurred
+#ifdef CFG_stop_mode
+    u1_t nostop;    // stop mode inhibited
+#endif
+    hal_spicb_t spicb; // pending SPI burst completion callback
+#ifdef CFG_irq_stats
+    u4_t irqoff;    // cycle count when IRQs got disabled
+    u4_t irqoffmax; // worst-case IRQ-disabled time (cycles)
+    u4_t isrmax;    // worst-case IRQ handler duration (cycles)
+#endif
 } HAL;
 
+#ifdef CFG_irq_stats
+// measure with the DWT cycle counter
+#define STATS_BEGIN(t)   u4_t t = DWT->CYCCNT
+#define STATS_END(t,max) do { u4_t d = DWT->CYCCNT - (t); if(d > (max)) (max) = d; } while(0)
+#else
+#define STATS_BEGIN(t)   /**/
+#define STATS_END(t,max) /**/
+#endif
+
 // -----------------------------------------------------------------------------
 // I/O
 
@@ -142,6 +163,9 @@ extern void radio_irq_handler(u1_t dio);
 
 // generic EXTI IRQ handler for all channels
 void EXTI_IRQHandler () {
+    STATS_BEGIN(t0);
+    // leave hal_sleep()
+    HAL.wakeup = 1;
     // DIO 0
     if((EXTI->PR & (1<<DIO0_PIN)) != 0) { // pending
         EXTI->PR = (1<<DIO0_PIN); // clear irq
@@ -167,6 +191,7 @@ void EXTI_IRQHandler () {
         CFG_EXTI_IRQ_HANDLER();
     }
 #endif // CFG_EXTI_IRQ_HANDLER
+    STATS_END(t0, HAL.isrmax);
 }
 
 #if CFG_enzo_clib
@@ -225,6 +250,13 @@ static void hal_spi_init () {
     // configure and activate the SPI (master, internal slave select, software slave mgmt)
     // (use default mode: 8-bit, 2-wire, no crc, MSBF, PCLK/2, CPOL0, CPHA0)
     SPI2->CR1 = SPI_CR1_MSTR | SPI_CR1_SSI | SPI_CR1_SSM | SPI_CR1_SPE;
+
+#ifndef CFG_spi_nodma
+    // enable clock for DMA1 (channel 4: SPI2_RX, channel 5: SPI2_TX)
+    RCC->AHBENR |= RCC_AHBENR_DMA1EN;
+    NVIC->IP[DMA1_Channel4_IRQn] = 0x70; // interrupt priority
+    NVIC->ISER[DMA1_Channel4_IRQn>>5] = 1<<(DMA1_Channel4_IRQn&0x1F);  // set enable IRQ
+#endif
 }
 
 // perform SPI transaction with radio
@@ -234,6 +266,106 @@ u1_t hal_spi (u1_t out) {
     return SPI2->DR; // in
 }
 
+#ifndef CFG_spi_nodma
+
+enum { SPI_DMA_MIN = 4 }; // shorter bursts are cheaper to poll
+
+static const u1_t spi_txfill = 0x00; // sent if tx is NULL
+static u1_t spi_rxsink;               // received if rx is NULL
+static volatile u1_t spi_busy;        // DMA burst in progress
+
+// set up both DMA channels and start the burst
+static void spi_dma_start (const u1_t* tx, u1_t* rx, u2_t len) {
+    DMA1_Channel4->CCR = 0;
+    DMA1_Channel5->CCR = 0;
+    DMA1->IFCR = DMA_IFCR_CGIF4 | DMA_IFCR_CGIF5;
+    // channel 4: SPI2->DR to memory, completes when the last byte is clocked in
+    DMA1_Channel4->CPAR  = (u4_t)&SPI2->DR;
+    DMA1_Channel4->CMAR  = (u4_t)(rx ? rx : &spi_rxsink);
+    DMA1_Channel4->CNDTR = len;
+    DMA1_Channel4->CCR   = (rx ? DMA_CCR1_MINC : 0) | DMA_CCR1_PL_0 | DMA_CCR1_TCIE | DMA_CCR1_EN;
+    // channel 5: memory to SPI2->DR
+    DMA1_Channel5->CPAR  = (u4_t)&SPI2->DR;
+    DMA1_Channel5->CMAR  = (u4_t)(tx ? tx : &spi_txfill);
+    DMA1_Channel5->CNDTR = len;
+    DMA1_Channel5->CCR   = (tx ? DMA_CCR1_MINC : 0) | DMA_CCR1_DIR | DMA_CCR1_EN;
+    // go
+    SPI2->CR2 = SPI_CR2_RXDMAEN | SPI_CR2_TXDMAEN;
+}
+
+// release DMA channels after the burst
+static void spi_dma_stop () {
+    SPI2->CR2 = 0;
+    DMA1_Channel4->CCR = 0;
+    DMA1_Channel5->CCR = 0;
+    DMA1->IFCR = DMA_IFCR_CGIF4 | DMA_IFCR_CGIF5;
+}
+
+void DMA1_Channel4_IRQHandler () {
+    if(DMA1->ISR & DMA_ISR_TCIF4) { // burst complete
+        spi_dma_stop();
+        spi_busy = 0;
+        hal_spicb_t cb = HAL.spicb;
+        HAL.spicb = NULL;
+        HAL.wakeup = 1;
+        if(cb) {
+            cb();
+        }
+    }
+}
+
+#endif // !CFG_spi_nodma
+
+// perform SPI burst transaction with radio
+void hal_spi_xfer (const u1_t* tx, u1_t* rx, u2_t len, hal_spicb_t done_cb) {
+#ifndef CFG_spi_nodma
+    if(len >= SPI_DMA_MIN) {
+        if(done_cb) { // asynchronous, complete on IRQ
+            HAL.spicb = done_cb;
+            spi_busy = 1;
+            spi_dma_start(tx, rx, len);
+            return;
+        }
+        PWR->CR &= ~PWR_CR_LPSDSR; // (DMA keeps running in sleep mode)
+        if(HAL.irqlevel == 0) {
+            // synchronous, sleep until the DMA IRQ ends the burst while
+            // other IRQs keep being served
+            HAL.spicb = NULL;
+            spi_busy = 1;
+            spi_dma_start(tx, rx, len);
+            __disable_irq();
+            while(spi_busy) {
+                __WFI();
+                // let the pending IRQ run
+                __enable_irq();
+                __disable_irq();
+            }
+            __enable_irq();
+        } else {
+            // the caller keeps IRQs off (e.g. os_radio()), so poll the
+            // channel and wake on its pending IRQ without serving it
+            spi_dma_start(tx, rx, len);
+            while( (DMA1->ISR & DMA_ISR_TCIF4) == 0 ) {
+                __WFI();
+            }
+            spi_dma_stop();
+            NVIC->ICPR[DMA1_Channel4_IRQn>>5] = 1<<(DMA1_Channel4_IRQn&0x1F);  // clear pending IRQ
+        }
+        return;
+    }
+#endif // !CFG_spi_nodma
+    // polled fallback
+    for(u2_t i=0; i<len; i++) {
+        u1_t v = hal_spi(tx ? tx[i] : 0x00);
+        if(rx) {
+            rx[i] = v;
+        }
+    }
+    if(done_cb) {
+        done_cb();
+    }
+}
+
 #ifdef CFG_enzo_clib
 
 // -----------------------------------------------------------------------------
@@ -295,56 +427,257 @@ void hal_waitUntil (u4_t time) {
     while( deltaticks(time) != 0 ); // busy wait until timestamp is reached
 }
 
+// program comparator for target time dt ticks ahead if it is within one
+// timer period, otherwise leave it to the overflow interrupt
+static void armtimer (u2_t dt) {
+    if(dt < 5) { // event is now (a few ticks ahead)
+        TIM9->DIER &= ~TIM_DIER_CC2IE; // disable IE
+        HAL.armed = 0;
+        HAL.wakeup = 1;
+    } else if(dt != 0xFFFF) { // rewind timer to exact time
+        TIM9->CCR2 = TIM9->CNT + dt;   // set comparator
+        TIM9->SR &= ~TIM_SR_CC2IF;     // drop a stale match from an earlier period
+        TIM9->DIER |= TIM_DIER_CC2IE;  // enable IE
+        TIM9->CCER |= TIM_CCER_CC2E;   // enable capture/compare uint 2
+    } else { // far ahead, re-evaluated at next overflow
+        TIM9->DIER &= ~TIM_DIER_CC2IE; // disable IE
+    }
+}
+
 // check and rewind for target time
 u1_t hal_checkTimer (u4_t time) {
-    u2_t dt;
     TIM9->SR &= ~TIM_SR_CC2IF; // clear any pending interrupts
-    if((dt = deltaticks(time)) < 5) { // event is now (a few ticks ahead)
+    // forget earlier wakeups, the run loop is about to look at all its work
+    HAL.wakeup = 0;
+    u2_t dt = deltaticks(time);
+    if(dt < 5) { // event is now (a few ticks ahead)
         TIM9->DIER &= ~TIM_DIER_CC2IE; // disable IE
+        HAL.armed = 0;
         return 1;
-    } else { // rewind timer (fully or to exact time))
-        TIM9->CCR2 = TIM9->CNT + dt;   // set comparator
-        TIM9->DIER |= TIM_DIER_CC2IE;  // enable IE
-        TIM9->CCER |= TIM_CCER_CC2E;   // enable capture/compare uint 2
+    } else { // rewind timer for target time
+        HAL.target = time;
+        HAL.armed = 1;
+        armtimer(dt); // (same delta as checked, so it stays armed)
         return 0;
     }
 }
-  
+
 void TIM9_IRQHandler () {
-    if(TIM9->SR & TIM_SR_UIF) { // overflow
+    STATS_BEGIN(t0);
+    u2_t sr = TIM9->SR;
+    TIM9->SR = ~sr; // clear IRQ flags (rc_w0)
+    if(sr & TIM_SR_UIF) { // overflow
         HAL.ticks++;
+        // only wake up the run loop once the target is within reach
+        if(HAL.armed && (TIM9->DIER & TIM_DIER_CC2IE) == 0) {
+            armtimer(deltaticks(HAL.target));
+        }
+    }
+    if((sr & TIM_SR_CC2IF) && (TIM9->DIER & TIM_DIER_CC2IE)) { // expired
+        TIM9->DIER &= ~TIM_DIER_CC2IE;
+        HAL.armed = 0;
+        HAL.wakeup = 1;
+    }
+    STATS_END(t0, HAL.isrmax);
+}
+
+#ifdef CFG_stop_mode
+// -----------------------------------------------------------------------------
+// STOP MODE
+//
+// TIM9 halts in stop mode. The RTC keeps running from the LSE, its wakeup
+// timer ends the stop period and its calendar bridges the time spent stopped.
+// The sub-second register (SSR) is required, i.e. a Cat.2 or higher device.
+
+#if OSTICKS_PER_SEC != 32768 || CFG_clock_HSE
+#error CFG_stop_mode requires the LSE tick source (OSTICKS_PER_SEC == 32768)
+#endif
+
+enum { STOP_MIN_TICKS  = ms2osticks(20) };       // minimum time to the next deadline for stop mode
+enum { STOP_WAKE_TICKS = ms2osticks(4) };        // clock restart margin before the deadline
+enum { STOP_DAY_TICKS  = 86400u * OSTICKS_PER_SEC }; // RTC calendar wrap
+
+#define RTC_UNLOCK() do { RTC->WPR = 0xCA; RTC->WPR = 0x53; } while(0)
+#define RTC_LOCK()   do { RTC->WPR = 0xFF; } while(0)
+
+static void hal_rtc_init () {
+    // clock RTC from LSE (already running, see hal_time_init)
+    RCC->CSR |= RCC_CSR_RTCSEL_LSE;
+    RCC->CSR |= RCC_CSR_RTCEN;
+
+    RTC_UNLOCK();
+    RTC->ISR |= RTC_ISR_INIT; // enter init mode
+    while( (RTC->ISR & RTC_ISR_INITF) == 0 );
+    // ck_apre = LSE, ck_spre = 1Hz, sub-seconds count LSE periods
+    RTC->PRER = (OSTICKS_PER_SEC - 1);
+    RTC->PRER = (OSTICKS_PER_SEC - 1) | (0 << 16);
+    RTC->ISR &= ~RTC_ISR_INIT;
+
+    // wakeup timer clocked from RTCCLK/16 (2048Hz, 16 ticks)
+    RTC->CR &= ~RTC_CR_WUTE;
+    while( (RTC->ISR & RTC_ISR_WUTWF) == 0 );
+    RTC->CR = (RTC->CR & ~RTC_CR_WUCKSEL) | RTC_CR_WUTIE;
+    RTC_LOCK();
+
+    // wakeup timer event is routed via EXTI line 20
+    EXTI->IMR  |= EXTI_IMR_MR20;
+    EXTI->RTSR |= EXTI_RTSR_TR20;
+    NVIC->IP[RTC_WKUP_IRQn] = 0x70; // interrupt priority
+    NVIC->ISER[RTC_WKUP_IRQn>>5] = 1<<(RTC_WKUP_IRQn&0x1F);  // set enable IRQ
+}
+
+#define BCD2(v) ((((v)>>4)&0xF)*10 + ((v)&0xF))
+
+// return RTC time of day in ticks
+static u4_t rtc_ticks () {
+    // wait for shadow registers to resync (mandatory after stop mode)
+    RTC_UNLOCK();
+    RTC->ISR &= ~RTC_ISR_RSF;
+    RTC_LOCK();
+    while( (RTC->ISR & RTC_ISR_RSF) == 0 );
+    u4_t ss = RTC->SSR;
+    u4_t tr = RTC->TR;
+    (void)RTC->DR; // unfreeze shadow registers
+    u4_t secs = BCD2(tr>>16) * 3600 + BCD2(tr>>8) * 60 + BCD2(tr);
+    return secs * OSTICKS_PER_SEC + (OSTICKS_PER_SEC - 1 - ss);
+}
+
+// enter stop mode for at most dt ticks, then resume TIM9 time base
+static void hal_stop (s4_t dt) {
+    u4_t wut = (dt - STOP_WAKE_TICKS) >> 4;
+    if(wut > 0x10000) {
+        wut = 0x10000; // 32s max, extended by next hal_sleep() round
     }
-    if((TIM9->SR & TIM_SR_CC2IF) && (TIM9->DIER & TIM_DIER_CC2IE)) { // expired
-        // do nothing, only wake up cpu
+    // RTC and TIM9 time at the same moment, TIM9 keeps counting until
+    // stop entry and again once the clock is back, the RTC bridges it all
+    u4_t t0 = rtc_ticks();
+    u4_t base = hal_ticks();
+    RTC_UNLOCK();
+    RTC->CR &= ~RTC_CR_WUTE;
+    while( (RTC->ISR & RTC_ISR_WUTWF) == 0 );
+    RTC->WUTR = wut - 1;
+    RTC->ISR &= ~RTC_ISR_WUTF;
+    RTC->CR |= RTC_CR_WUTE;
+    RTC_LOCK();
+    EXTI->PR = EXTI_PR_PR20;
+
+    // stop mode, regulator in low power mode
+    PWR->CR = (PWR->CR & ~PWR_CR_PDDS) | PWR_CR_LPSDSR | PWR_CR_CWUF;
+    SCB->SCR |= SCB_SCR_SLEEPDEEP_Msk;
+    __WFI();
+    SCB->SCR &= ~SCB_SCR_SLEEPDEEP_Msk;
+
+    // system clock falls back to MSI on wakeup
+    SystemInit();
+
+    RTC_UNLOCK();
+    RTC->CR &= ~RTC_CR_WUTE; // one-shot
+    RTC_LOCK();
+
+    // resume TIM9 time base from the RTC time elapsed since t0
+    u4_t t1 = rtc_ticks();
+    u4_t t = base + (t1 >= t0 ? t1 - t0 : t1 + STOP_DAY_TICKS - t0);
+    HAL.ticks = t >> 16;
+    TIM9->CNT = (u2_t)t;
+    TIM9->SR &= ~TIM_SR_UIF; // (an overflow since base is already in t)
+    if(HAL.armed) {
+        armtimer(deltaticks(HAL.target));
     }
-    TIM9->SR = 0; // clear IRQ flags
 }
 
+void RTC_WKUP_IRQHandler () {
+    RTC_UNLOCK();
+    RTC->ISR &= ~RTC_ISR_WUTF;
+    RTC_LOCK();
+    EXTI->PR = EXTI_PR_PR20;
+    // nothing else to do, hal_sleep() continues with the armed timer
+}
+
+void hal_allowStop (u1_t allow) {
+    HAL.nostop = !allow;
+}
+
+#else // CFG_stop_mode
+
+void hal_allowStop (u1_t allow) {
+}
+
+#endif // CFG_stop_mode
+
 // -----------------------------------------------------------------------------
 // IRQ
 
 void hal_disableIRQs () {
     __disable_irq();
+#ifdef CFG_irq_stats
+    if(HAL.irqlevel == 0) {
+        HAL.irqoff = DWT->CYCCNT;
+    }
+#endif
     HAL.irqlevel++;
 }
 
 void hal_enableIRQs () {
     if(--HAL.irqlevel == 0) {
+        STATS_END(HAL.irqoff, HAL.irqoffmax);
         __enable_irq();
     }
 }
 
+void hal_irqStats (u4_t* isrmax, u4_t* irqoffmax) {
+#ifdef CFG_irq_stats
+    hal_disableIRQs();
+    *isrmax = HAL.isrmax;
+    *irqoffmax = HAL.irqoffmax;
+    hal_enableIRQs();
+#else
+    *isrmax = *irqoffmax = 0;
+#endif
+}
+
+void hal_wakeup () {
+    HAL.wakeup = 1;
+}
+
 void hal_sleep () {
-    // low power sleep mode
-    PWR->CR |= PWR_CR_LPSDSR;
-    // suspend execution until IRQ, regardless of the CPSR I-bit
-    __WFI();
+    // timer overflows are handled here and don't leave hal_sleep()
+    // (IRQs are disabled since the run loop found nothing to do, so earlier
+    // wakeups are accounted for; a timer that expired while it was being
+    // armed is still pending and ends the first WFI)
+    HAL.wakeup = 0;
+    do {
+#ifdef CFG_stop_mode
+        s4_t dt = HAL.target - hal_ticks();
+        if(HAL.armed && !HAL.nostop && dt >= STOP_MIN_TICKS) {
+            hal_stop(dt);
+        } else
+#endif // CFG_stop_mode
+        {
+            // low power sleep mode
+            PWR->CR |= PWR_CR_LPSDSR;
+            // suspend execution until IRQ, regardless of the CPSR I-bit
+            __WFI();
+        }
+        // let the pending IRQ run
+        __enable_irq();
+        __disable_irq();
+    } while(!HAL.wakeup);
+#ifdef CFG_irq_stats
+    // time asleep doesn't count as IRQ-disabled
+    HAL.irqoff = DWT->CYCCNT;
+#endif
 }
 
 // -----------------------------------------------------------------------------
 
 void hal_init () {
     memset(&HAL, 0x00, sizeof(HAL));
+#ifdef CFG_irq_stats
+    // enable DWT cycle counter
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+#endif
     hal_disableIRQs();
 
     // configure radio I/O and interrupt handler
@@ -353,6 +686,10 @@ void hal_init () {
     hal_spi_init();
     // configure timer and interrupt handler
     hal_time_init();
+#ifdef CFG_stop_mode
+    // configure stop mode wakeup source
+    hal_rtc_init();
+#endif
 
     hal_enableIRQs();
 }
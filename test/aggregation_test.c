@@ -0,0 +1,177 @@
+/*
+ * host test: a node packs its queued forwarded and local records into as
+ * few frames as fit MAX_LEN_FRAME until its queues are flushed, and the
+ * root unpacks every record from them exactly once
+ *
+ * build and run from the repository root:
+ *   gcc -std=gnu99 -Ienzo -Istm32 -DCFG_sx1272_radio test/aggregation_test.c enzo/enzo.c -o aggregation_test && ./aggregation_test
+ *
+ * blink.c is included to drive _data_tx and _rx_root_done directly; the
+ * OS, radio and debug output are stubbed. The node sits one hop from the
+ * root, in its source mini-slot; the frames it sends are handed to the
+ * root as they were.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "../enzo/blink.c"
+
+// stubs
+static u4_t tx_complete;
+
+ostime_t os_getTime (void) { return 0; }
+void os_setCallback (osjob_t* job, osjobcb_t cb) { job->func = cb; }
+void os_clearCallback (osjob_t* job) { }
+void os_setTimedCallback (osjob_t* job, ostime_t time, osjobcb_t cb) {
+  job->deadline = time;
+  job->func = cb;
+}
+void os_radio (u1_t mode) { }
+u1_t radio_rand1 (void) { return rand(); }
+s2_t radio_rssi2dBm (u1_t rssi) { return (s2_t)rssi - 139; }
+void debug_char (u1_t c) { }
+void debug_hex (u1_t b) { }
+void debug_buf (const u1_t* buf, u2_t len) { }
+void debug_uint (u4_t v) { }
+void debug_str (const u1_t* str) { }
+void debug_led (u1_t val) { }
+void on_event (event_t ev) {
+  if(ev == EVENT_TXCOMPLETE) {
+    tx_complete++;
+  }
+}
+void hal_failed (u1_t* file, u4_t line) {
+  printf("FAIL assert %s:%u\n", file, line);
+  exit(1);
+}
+
+#define CHECK(cond) do { if(!(cond)) { printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); exit(1); } } while(0)
+
+enum { NODE = 5, CHILD = 9, ROUNDS = 20 };
+enum { RECORDS = ROUNDS * 2 * TX_QUEUE_DEPTH };  // a forward and a local queue full per round
+
+// frames sent by the node, in order
+static u1_t frames[RECORDS][MAX_LEN_FRAME];
+static u1_t frame_len[RECORDS];
+static u2_t nframes;
+
+// records in the order the node must send them
+static record_t sent[RECORDS];
+static u2_t nsent;
+
+// a record with a random payload, mostly sensor reading sized
+static void record (record_t* r, u2_t src, u1_t seq) {
+  r->hdr.len  = rand() % 4 ? 1 + rand() % 8 : rand() % (MAX_PAYLOAD_LEN + 1);
+  r->hdr.age  = src == NODE ? 0 : 3;
+  r->hdr.seq  = seq;
+  r->hdr.src  = src;
+  r->hdr.path = src == NODE ? 0 : 1;
+  for(u1_t i = 0; i < r->hdr.len; i++) {
+    r->payload[i] = rand();
+  }
+}
+
+int main () {
+  ENZO_reset();
+  blink_init();
+  BLINK.nodeid = NODE;
+  blink_reset();
+  srand(1);
+  // one hop from the root, in our source mini-slot
+  BLINK.opmode |= OP_TRACK;
+  BLINK.hop = 1;
+  BLINK.parent = ROOT_ID;
+  u2_t v = _source_vslot();
+  BLINK.slot = BEACON_SLOTS + v / BLINK.minislots;
+  BLINK.minislot = v % BLINK.minislots;
+  CHECK(_tx_classes() == ((1 << TXQ_LOCAL) | (1 << TXQ_FORWARD)));
+
+  u4_t local_frames = 0, bytes = 0;
+  for(u2_t n = 0; n < ROUNDS; n++) {
+    // full queues, forwarded records go first
+    record_t r;
+    for(u1_t i = 0; i < TX_QUEUE_DEPTH; i++) {
+      record(&r, CHILD, n * TX_QUEUE_DEPTH + i);
+      CHECK(_txq_put(TXQ_FORWARD, &r));
+      sent[nsent + i] = r;
+    }
+    for(u1_t i = 0; i < TX_QUEUE_DEPTH; i++) {
+      record(&r, NODE, 0);
+      CHECK(blink_tx(r.payload, r.hdr.len));
+      r.hdr.seq = BLINK.seq - 1;
+      sent[nsent + TX_QUEUE_DEPTH + i] = r;
+    }
+
+    // flush them
+    u2_t k = nsent;
+    nsent += 2 * TX_QUEUE_DEPTH;
+    while(BLINK.pending & PEND_DATA_TX) {
+      _data_tx(NULL);
+      CHECK(ENZO.dataLen <= MAX_LEN_FRAME && _frame_valid(DATA));
+      header_t* h = (header_t*)ENZO.frame;
+      CHECK(h->type == DATA && h->src == NODE && h->dest == ROOT_ID && h->hop == 1);
+      // the records as queued, in order
+      u1_t off = SIZEOFEXPR(header_t);
+      u1_t local = 0;
+      while(off < ENZO.dataLen) {
+        record_t f;
+        u1_t n = _record_unpack(off, &f);
+        CHECK(k < nsent && n == _record_size(&sent[k], NODE));
+        CHECK(memcmp(&f, &sent[k], SIZEOFEXPR(record_hdr_t) + f.hdr.len) == 0);
+        local |= f.hdr.src == NODE;
+        bytes += f.hdr.len;
+        off += n;
+        k++;
+      }
+      // nothing left behind that would have fit
+      CHECK(k == nsent || ENZO.dataLen + _record_size(&sent[k], NODE) > MAX_LEN_FRAME);
+      local_frames += local;
+      os_copyMem(frames[nframes], ENZO.frame, ENZO.dataLen);
+      frame_len[nframes++] = ENZO.dataLen;
+      _tx_finish(1);
+    }
+    CHECK(k == nsent);
+    CHECK(_txq_peek(0xFF, NULL) == NULL && tx_len == 0);
+  }
+  CHECK(BLINK.stats.tx_records == RECORDS && BLINK.stats.tx_frames == nframes);
+  CHECK(tx_complete == local_frames);
+
+  // the root unpacks all of them
+  BLINK.opmode = 0;
+  BLINK.nodeid = ROOT_ID;
+  blink_reset();
+  os_clearMem(&BLINK.stats, sizeof(BLINK.stats));
+  for(u2_t i = 0; i < nframes; i++) {
+    os_copyMem(ENZO.frame, frames[i], frame_len[i]);
+    ENZO.dataLen = frame_len[i];
+    ENZO.crcerr = 0;
+    _rx_root_done(NULL);
+  }
+  CHECK(BLINK.stats.rx_frames == nframes);
+  CHECK(BLINK.stats.rx_records == RECORDS && BLINK.stats.rx_bytes == bytes);
+  CHECK(BLINK.stats.rx_duplicates == 0);
+
+  // a retransmitted frame is dropped record by record
+  u4_t ticks = BLINK.stats.rx_ticks;
+  os_copyMem(ENZO.frame, frames[nframes - 1], frame_len[nframes - 1]);
+  ENZO.dataLen = frame_len[nframes - 1];
+  u1_t last = 0;
+  for(u1_t off = SIZEOFEXPR(header_t); off < ENZO.dataLen; last++) {
+    off += _record_unpack(off, NULL);
+  }
+  _rx_root_done(NULL);
+  CHECK(BLINK.stats.rx_records == RECORDS && BLINK.stats.rx_duplicates == last);
+
+  // against one record per frame
+  u4_t single = 0;
+  for(u2_t i = 0; i < nsent; i++) {
+    single += calcAirTimePre(ENZO.rps, SIZEOFEXPR(header_t) + _record_size(&sent[i], NODE), _data_preamble());
+  }
+  printf("%u records in %u frames (%.2f per frame), %.2f ms airtime per delivered byte, %.2f ms unaggregated\n",
+         RECORDS, nframes, (double)RECORDS / nframes,
+         ticks * 1000.0 / OSTICKS_PER_SEC / bytes, single * 1000.0 / OSTICKS_PER_SEC / bytes);
+  CHECK(nframes < RECORDS && ticks < single);
+
+  printf("ok: aggregation\n");
+  return 0;
+}
@@ -0,0 +1,120 @@
+/*
+ * host test: adaptive beacon skipping engages in an epoch with empty
+ * beacon slots
+ *
+ * build and run from the repository root:
+ *   gcc -std=gnu99 -Ienzo -Istm32 -DCFG_sx1272_radio test/bcn_skip_test.c enzo/enzo.c -o bcn_skip_test && ./bcn_skip_test
+ *
+ * blink.c is included to drive its slot handling directly; the OS, radio
+ * and debug output are stubbed, beacon slot outcomes are simulated.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "../enzo/blink.c"
+
+// stubs
+static ostime_t now;
+static u1_t beacon_rx_scheduled;
+static u1_t beacon_tx_scheduled;
+
+ostime_t os_getTime (void) { return now; }
+void os_setCallback (osjob_t* job, osjobcb_t cb) { job->func = cb; }
+void os_clearCallback (osjob_t* job) { }
+void os_setTimedCallback (osjob_t* job, ostime_t time, osjobcb_t cb) {
+  job->deadline = time;
+  job->func = cb;
+  if(job == &_receive_job && cb == FUNC_ADDR(_beacon_rx)) {
+    beacon_rx_scheduled = 1;
+  }
+  if(job == &_transmit_job && cb == FUNC_ADDR(_beacon_tx)) {
+    beacon_tx_scheduled = 1;
+  }
+}
+void os_radio (u1_t mode) { }
+u1_t radio_rand1 (void) { return rand(); }
+s2_t radio_rssi2dBm (u1_t rssi) { return (s2_t)rssi - 139; }
+void debug_char (u1_t c) { }
+void debug_hex (u1_t b) { }
+void debug_buf (const u1_t* buf, u2_t len) { }
+void debug_uint (u4_t v) { }
+void debug_str (const u1_t* str) { }
+void debug_led (u1_t val) { }
+void on_event (event_t ev) { }
+void hal_failed (u1_t* file, u4_t line) {
+  printf("FAIL assert %s:%u\n", file, line);
+  exit(1);
+}
+
+#define CHECK(cond) do { if(!(cond)) { printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); exit(1); } } while(0)
+
+enum { PARENT = 1, NODE = 5, EPOCHS = 40 };
+
+int main () {
+  ENZO_reset();
+  blink_init();
+  BLINK.nodeid = NODE;
+  blink_reset();
+  // tracking a parent one hop up, with a settled clock
+  BLINK.opmode |= OP_TRACK;
+  BLINK.hop = 2;
+  BLINK.parent = PARENT;
+  BLINK.nbr[0].used = 1;
+  BLINK.nbr[0].id   = PARENT;
+  BLINK.nbr[0].hop  = 1;
+  BLINK.nbr[0].prr  = 0xF0;
+  drift_len = DRIFT_SAMPLES;
+  BLINK.slot = TIME_SLOTS - 1;
+  CHECK(BEACON_SLOTS > 3);
+
+  u4_t listened_first = 0, listened = 0;
+  for(u2_t e = 0; e < EPOCHS; e++) {
+    for(u2_t s = 0; s < TIME_SLOTS; s++) {
+      now += TIME_SLOT_ticks;
+      _wakeup_job.deadline = now;
+      beacon_rx_scheduled = 0;
+      beacon_tx_scheduled = 0;
+      _wakeup(&_wakeup_job);
+      CHECK(BLINK.slot == s);
+      if(beacon_tx_scheduled) {
+        // our own beacon goes out
+        _beacon_tx(&_transmit_job);
+        _tx_done(&ENZO.osjob);
+      }
+      if(!beacon_rx_scheduled) {
+        continue;
+      }
+      listened++;
+      if(e == 0) {
+        listened_first++;
+      }
+      if(BLINK.slot + 1 == BLINK.hop) {
+        // the parent's beacon, on time, to be passed on in our slot
+        BLINK.nbr[0].heard = 1;
+        BLINK.missed_beacons = 0;
+        BLINK.sync_err = 0;
+        BLINK.pending |= PEND_BEACON_TX;
+      } else {
+        // nobody beacons in this slot, the RX window times out
+        BLINK.opmode |= OP_RXBCN;
+        ENZO.dataLen = 0;
+        ENZO.crcerr = 0;
+        _rx_done(&ENZO.osjob);
+      }
+      CHECK(BLINK.opmode & OP_TRACK);
+    }
+  }
+  // skipping engaged and sleeps through most beacon rounds by now
+  CHECK(BLINK.stats.bcn_skipped > 0);
+  CHECK(BLINK.bcn_run == BCN_SKIP_MAX);
+  CHECK(listened_first == BEACON_SLOTS - 1);
+  CHECK(listened < EPOCHS * listened_first / 2);
+
+  // a missed parent beacon makes the node listen to every round again
+  BLINK.slot = BLINK.hop - 1;
+  _missed_beacon();
+  CHECK(BLINK.bcn_skip == 0 && BLINK.bcn_streak == 0);
+
+  printf("ok: %u beacon rounds skipped\n", BLINK.stats.bcn_skipped);
+  return 0;
+}
@@ -0,0 +1,130 @@
+/*
+ * host test: TLV beacons round trip, the parser skips unknown fields and
+ * rejects broken ones; prints the beacon airtime at each SF
+ *
+ * build and run from the repository root:
+ *   gcc -std=gnu99 -Ienzo -Istm32 -DCFG_sx1272_radio test/beacon_test.c enzo/enzo.c -o beacon_test && ./beacon_test
+ *
+ * blink.c is included to build beacons with _beacon_tx and parse them
+ * with _frame_valid; the OS, radio and debug output are stubbed.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "../enzo/blink.c"
+
+// stubs
+ostime_t os_getTime (void) { return 0; }
+void os_setCallback (osjob_t* job, osjobcb_t cb) { job->func = cb; }
+void os_clearCallback (osjob_t* job) { }
+void os_setTimedCallback (osjob_t* job, ostime_t time, osjobcb_t cb) {
+  job->deadline = time;
+  job->func = cb;
+}
+void os_radio (u1_t mode) { }
+u1_t radio_rand1 (void) { return rand(); }
+s2_t radio_rssi2dBm (u1_t rssi) { return (s2_t)rssi - 139; }
+void debug_char (u1_t c) { }
+void debug_hex (u1_t b) { }
+void debug_buf (const u1_t* buf, u2_t len) { }
+void debug_uint (u4_t v) { }
+void debug_str (const u1_t* str) { }
+void debug_led (u1_t val) { }
+void on_event (event_t ev) { }
+void hal_failed (u1_t* file, u4_t line) {
+  printf("FAIL assert %s:%u\n", file, line);
+  exit(1);
+}
+
+#define CHECK(cond) do { if(!(cond)) { printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); exit(1); } } while(0)
+
+enum { TIME_ms = 123456 };
+enum { REQUIRED = (1 << BCN_EPOCH) | (1 << BCN_TIME) | (1 << BCN_ETX) };
+
+// the root's beacon of an epoch, left in the radio buffer
+static u1_t beacon (u2_t epoch) {
+  BLINK.epoch = epoch;
+  BLINK.net_ms = TIME_ms;
+  _beacon_tx(NULL);
+  return ENZO.dataLen;
+}
+
+int main () {
+  ENZO_reset();
+  blink_init();
+  BLINK.nodeid = ROOT_ID;
+  blink_reset();
+  BLINK.slot = 0;
+  u2_t digest = _cfg_digest(&BLINK.cfg);
+
+  // in between the repeats the frame structure is only a digest
+  u1_t plain = beacon(BCN_CONFIG_EVERY + 1);
+  CHECK(_frame_valid(BEACON));
+  CHECK(beacon_rx.header.src == ROOT_ID && beacon_rx.header.hop == 0);
+  CHECK(beacon_rx.fields == (REQUIRED | (1 << BCN_DIGEST)));
+  CHECK(beacon_rx.epoch == BCN_CONFIG_EVERY + 1);
+  CHECK(beacon_rx.time == TIME_ms + BLINK.cfg.drift_ms);
+  CHECK(beacon_rx.etx == BLINK.etx);
+  CHECK(beacon_rx.digest == digest);
+
+  // repeated for late joiners
+  u1_t full = beacon(BCN_CONFIG_EVERY);
+  CHECK(full > plain);
+  CHECK(_frame_valid(BEACON));
+  CHECK(beacon_rx.fields & (1 << BCN_CONFIG));
+  CHECK(memcmp(&beacon_rx.next, &BLINK.next, sizeof(BLINK.next)) == 0);
+
+  // and every epoch while a switch is coming
+  BLINK.next.epoch = BCN_CONFIG_EVERY + 40;
+  BLINK.next.cfg.slots = BLINK.cfg.slots * 2;
+  CHECK(beacon(BCN_CONFIG_EVERY + 1) == full);
+  CHECK(_frame_valid(BEACON));
+  CHECK(beacon_rx.next.epoch == BCN_CONFIG_EVERY + 40);
+  CHECK(beacon_rx.next.cfg.slots == BLINK.cfg.slots * 2);
+  CHECK(beacon_rx.digest == digest);
+  BLINK.next.cfg = BLINK.cfg;
+
+  // a field from a newer version is skipped
+  beacon(BCN_CONFIG_EVERY + 1);
+  u1_t extra[3] = { 1, 2, 3 };
+  ENZO.dataLen = _tlv_put(ENZO.dataLen, 0x7F, extra, sizeof(extra));
+  CHECK(_frame_valid(BEACON));
+  CHECK(beacon_rx.fields == (REQUIRED | (1 << BCN_DIGEST)));
+  CHECK(beacon_rx.epoch == BCN_CONFIG_EVERY + 1);
+
+  // cut short
+  beacon(BCN_CONFIG_EVERY + 1);
+  ENZO.dataLen--;
+  CHECK(!_frame_valid(BEACON));
+
+  // a known field of the wrong size
+  ENZO.dataLen = SIZEOFEXPR(header_t);
+  u4_t epoch = 3;
+  ENZO.dataLen = _tlv_put(ENZO.dataLen, BCN_EPOCH, &epoch, sizeof(epoch));
+  ENZO.dataLen = _tlv_put(ENZO.dataLen, BCN_TIME, &epoch, sizeof(epoch));
+  ENZO.dataLen = _tlv_put(ENZO.dataLen, BCN_ETX, &BLINK.etx, sizeof(BLINK.etx));
+  CHECK(!_frame_valid(BEACON));
+
+  // a required field missing
+  ENZO.dataLen = SIZEOFEXPR(header_t);
+  ENZO.dataLen = _tlv_put(ENZO.dataLen, BCN_EPOCH, &BLINK.epoch, sizeof(BLINK.epoch));
+  ENZO.dataLen = _tlv_put(ENZO.dataLen, BCN_ETX, &BLINK.etx, sizeof(BLINK.etx));
+  CHECK(!_frame_valid(BEACON));
+
+  // airtime of the bare header (what a beacon used to carry), the
+  // beacon, and the beacon repeating the frame structure
+  u1_t bare = SIZEOFEXPR(header_t);
+  printf("beacon airtime (ms): %u bytes header only, %u bytes beacon, %u bytes with config\n",
+         bare, plain, full);
+  printf("sf   header  beacon  config\n");
+  for(u1_t sf = SF7; sf <= SF12; sf++) {
+    rps_t rps = makeRps(sf, BW125, CR_4_5, 0, 0);
+    printf("%2u %8.1f %7.1f %7.1f\n", 7 + sf - SF7,
+           calcAirTime(rps, bare) * 1000.0 / OSTICKS_PER_SEC,
+           calcAirTime(rps, plain) * 1000.0 / OSTICKS_PER_SEC,
+           calcAirTime(rps, full) * 1000.0 / OSTICKS_PER_SEC);
+  }
+
+  printf("ok: beacon tlv\n");
+  return 0;
+}
@@ -0,0 +1,108 @@
+/*
+ * host test: the drift estimator converges on the clock drift against
+ * the parent, and the drift corrected slot grid keeps the residual sync
+ * error of the next parent beacon small
+ *
+ * build and run from the repository root:
+ *   gcc -std=gnu99 -Ienzo -Istm32 -DCFG_sx1272_radio test/drift_test.c enzo/enzo.c -o drift_test && ./drift_test
+ *
+ * blink.c is included to drive its estimator and slot grid directly; the
+ * OS, radio and debug output are stubbed. The parent beacons once per
+ * epoch, its beacons reach us with a few ticks of timestamp jitter.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "../enzo/blink.c"
+
+// stubs
+ostime_t os_getTime (void) { return 0; }
+void os_setCallback (osjob_t* job, osjobcb_t cb) { job->func = cb; }
+void os_clearCallback (osjob_t* job) { }
+void os_setTimedCallback (osjob_t* job, ostime_t time, osjobcb_t cb) {
+  job->deadline = time;
+  job->func = cb;
+}
+void os_radio (u1_t mode) { }
+u1_t radio_rand1 (void) { return rand(); }
+s2_t radio_rssi2dBm (u1_t rssi) { return (s2_t)rssi - 139; }
+void debug_char (u1_t c) { }
+void debug_hex (u1_t b) { }
+void debug_buf (const u1_t* buf, u2_t len) { }
+void debug_uint (u4_t v) { }
+void debug_str (const u1_t* str) { }
+void debug_led (u1_t val) { }
+void on_event (event_t ev) { }
+void hal_failed (u1_t* file, u4_t line) {
+  printf("FAIL assert %s:%u\n", file, line);
+  exit(1);
+}
+
+#define CHECK(cond) do { if(!(cond)) { printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); exit(1); } } while(0)
+
+enum { EPOCHS = 40, JITTER = 3 };  // JITTER: ticks of arrival timestamp noise, either way
+
+static const s2_t drifts[] = { -95, -40, -7, 0, 12, 60, 100 };
+
+// local arrival time of the parent beacon of an epoch, with our clock
+// ppm fast against the parent's
+static ostime_t arrival (u2_t e, s2_t ppm) {
+  s8_t t = (s8_t)e * TIME_SLOTS * TIME_SLOT_ticks + SLOT_GUARD_ticks;
+  return 1000 + t + t * ppm / 1000000 + rand() % (2 * JITTER + 1) - JITTER;
+}
+
+int main () {
+  ENZO_reset();
+  blink_init();
+  BLINK.nodeid = 5;
+  blink_reset();
+  srand(1);
+
+  printf(" drift  estimate  residual sync error (ticks, mean/max)\n");
+  printf("   ppm       ppm  uncorrected      corrected\n");
+  for(u1_t d = 0; d < sizeof(drifts) / sizeof(drifts[0]); d++) {
+    s2_t ppm = drifts[d];
+    drift_len = drift_next = 0;
+    BLINK.drift_ppm = 0;
+    u4_t raw_sum = 0, raw_max = 0, err_sum = 0, err_max = 0, n = 0;
+    for(u2_t e = 0; e < EPOCHS; e++) {
+      ostime_t t = arrival(e, ppm);
+      BLINK.slots = (u4_t)e * TIME_SLOTS;
+      if(e > 0) {
+        // where our grid put this beacon, one epoch after the last anchor
+        u4_t err = abs(t - (_slot_start(BLINK.slots) + SLOT_GUARD_ticks));
+        u4_t raw = abs(t - (BLINK.anchor + TIME_SLOTS * TIME_SLOT_ticks + SLOT_GUARD_ticks));
+        if(drift_len >= DRIFT_MIN_SAMPLES) {
+          // the estimate is applied from here on
+          err_sum += err;
+          raw_sum += raw;
+          err_max = err > err_max ? err : err_max;
+          raw_max = raw > raw_max ? raw : raw_max;
+          n++;
+        }
+      }
+      // what _rx_beacon_done does with a parent beacon
+      _drift_sample((u4_t)e * TIME_SLOTS * BLINK.cfg.slot_ms + BLINK.cfg.drift_ms, t);
+      _anchor(t - SLOT_GUARD_ticks);
+    }
+    printf("  %4d      %4d  %5u / %5u  %5u / %5u\n", ppm, BLINK.drift_ppm,
+           raw_sum / n, raw_max, err_sum / n, err_max);
+    // the window assumes DRIFT_RESIDUAL_ppm once the estimate is in
+    CHECK(abs(BLINK.drift_ppm - ppm) <= DRIFT_RESIDUAL_ppm / 2);
+    ostime_t epoch = TIME_SLOTS * TIME_SLOT_ticks;
+    CHECK(err_max <= (epoch / 1000) * DRIFT_RESIDUAL_ppm / 1000 + 2 * JITTER);
+  }
+
+  // a parent that jumped by seconds is not taken for crystal drift, the
+  // window restarts and the last estimate stays
+  drift_len = drift_next = 0;
+  BLINK.drift_ppm = 0;
+  for(u2_t e = 0; e < DRIFT_SAMPLES; e++) {
+    ostime_t t = arrival(e, 30) + (e == DRIFT_SAMPLES - 1 ? sec2osticks(2) : 0);
+    _drift_sample((u4_t)e * TIME_SLOTS * BLINK.cfg.slot_ms, t);
+  }
+  CHECK(drift_len == 0 && abs(BLINK.drift_ppm - 30) <= 1);
+
+  printf("ok: drift estimator\n");
+  return 0;
+}
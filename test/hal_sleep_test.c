@@ -0,0 +1,97 @@
+/*
+ * host test: the run loop sleeps from one job to the next, without waking
+ * up at every timer overflow in between; prints the wakeups per epoch of
+ * a leaf node with and without the 16-bit timer overflows
+ *
+ * build and run from the repository root:
+ *   gcc -std=gnu99 -Ienzo -Ihost test/hal_sleep_test.c host/hal.c enzo/osenzo.c -o hal_sleep_test && ./hal_sleep_test
+ *
+ * The OS runs on the host HAL (host/hal.c) in simulated time, the radio
+ * is stubbed. The jobs follow a leaf node's blink epoch: a wakeup at
+ * every slot, a beacon received from the parent, a beacon relayed and
+ * one data frame sent, radio operations end through a timed job.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <setjmp.h>
+#include "enzo.h"
+#include "blink.h"
+#include "host.h"
+
+// stubs
+void radio_init (void) { }
+void ENZO_init (void) { }
+void radio_irq_handler (u1_t dio) { }
+u1_t radio_irq_pending (void) { return 0; }
+void radio_irq_process (void) { }
+
+#define CHECK(cond) do { if(!(cond)) { printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); exit(1); } } while(0)
+
+enum { EPOCHS = 20, HOP = 2, DATA_SLOT = DEFAULT_BEACON_SLOTS + 3 };
+enum { BEACON_ms = 1500, DATA_ms = 600 };  // radio operations, about SF12 airtime
+
+static osjob_t slot_job, radio_job;
+static ostime_t slot_time;
+static u2_t slot, epochs;
+static u4_t jobs;
+static jmp_buf done;
+
+static void radio_done (osjob_t* job) {
+  jobs++;
+}
+
+static void radio_start (osjob_t* job) {
+  jobs++;
+  u2_t ms = slot < DEFAULT_BEACON_SLOTS ? BEACON_ms : DATA_ms;
+  os_setTimedCallback(&radio_job, os_getTime() + ms2osticks(ms), FUNC_ADDR(radio_done));
+}
+
+static void slot_start (osjob_t* job) {
+  jobs++;
+  if(++slot == DEFAULT_TIME_SLOTS) {
+    slot = 0;
+    if(epochs++ == EPOCHS) {
+      longjmp(done, 1);
+    }
+  }
+  if(slot == HOP - 1 || slot == HOP || slot == DATA_SLOT) {
+    // the parent's beacon, our own beacon, our data frame
+    os_setTimedCallback(&radio_job, slot_time + ms2osticks(DEFAULT_MAX_DRIFT_ms), FUNC_ADDR(radio_start));
+  }
+  slot_time += ms2osticks(DEFAULT_TIME_SLOT_ms);
+  os_setTimedCallback(&slot_job, slot_time, FUNC_ADDR(slot_start));
+}
+
+static void run (u1_t tick16) {
+  host_sleep.tick16 = tick16;
+  os_init();
+  slot = DEFAULT_TIME_SLOTS - 1;
+  epochs = 0;
+  jobs = 0;
+  slot_time = os_getTime();
+  os_setCallback(&slot_job, FUNC_ADDR(slot_start));
+  if(!setjmp(done)) {
+    os_runloop();
+  }
+}
+
+int main () {
+  run(1);
+  u4_t before = host_sleep.wakeups;
+  u4_t overflows = hal_ticks() >> 16;
+  run(0);
+  u4_t after = host_sleep.wakeups;
+
+  printf("%u timed jobs per epoch of %u s\n", jobs / EPOCHS,
+         DEFAULT_TIME_SLOTS * DEFAULT_TIME_SLOT_ms / 1000);
+  printf("wakeups per epoch: %.1f with 16-bit timer overflows, %.1f tickless\n",
+         (double)before / EPOCHS, (double)after / EPOCHS);
+  // one wakeup per timed job, but for the first slot job (run right away)
+  CHECK(after == jobs - 1);
+  // and most overflows woke the CPU up as well (not those at a deadline)
+  CHECK(before - after <= overflows && before - after > overflows / 2);
+
+  printf("ok: hal sleep\n");
+  return 0;
+}
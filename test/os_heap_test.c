@@ -0,0 +1,217 @@
+/*
+ * host test: timed jobs run in deadline order, jobs with equal deadlines
+ * in the order they were scheduled, and jobs cleared from the middle of
+ * the heap never run; prints the cost of schedule, cancel and dispatch
+ * with 4, 64 and 1024 jobs queued
+ *
+ * build and run from the repository root:
+ *   gcc -std=gnu99 -O2 -Ienzo -Istm32 test/os_heap_test.c -o os_heap_test && ./os_heap_test
+ *
+ * osenzo.c is included to reach its timer heap directly; the HAL and
+ * radio are stubbed. The heap is built for BENCH_JOBS jobs, host CPU
+ * times are measured on the host.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define BENCH_JOBS 1024
+#define OS_MAX_TIMEDJOBS BENCH_JOBS
+#include "../enzo/osenzo.c"
+
+// stubs
+void hal_init (void) { }
+void radio_init (void) { }
+void ENZO_init (void) { }
+u4_t hal_ticks (void) { return 0; }
+void hal_disableIRQs (void) { }
+void hal_enableIRQs (void) { }
+u1_t hal_checkTimer (u4_t targettime) { return 1; }
+void hal_sleep (void) { }
+void hal_wakeup (void) { }
+u1_t radio_irq_pending (void) { return 0; }
+void radio_irq_process (void) { }
+void hal_failed (u1_t* file, u4_t line) {
+  printf("FAIL assert %s:%u\n", file, line);
+  exit(1);
+}
+
+#define CHECK(cond) do { if(!(cond)) { printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); exit(1); } } while(0)
+
+enum { JOBS = 32, ROUNDS = 200, RUNS = 200000 };
+
+static osjob_t jobs[JOBS];
+static u1_t order[JOBS + 1];  // job index per scheduling call, by scheduling order
+static u1_t nsched;
+
+static void cb (osjob_t* job) { }
+
+static double host_ns (void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// every slot holds its own index and no child runs before its parent
+static void check_heap (void) {
+  for(u2_t i = 0; i < OS.njobs; i++) {
+    CHECK(OS.heap[i]->qidx == i);
+    CHECK(OS.heap[i]->qstate == OSJOB_SCHEDULED);
+    if(i > 0) {
+      CHECK(!earlier(OS.heap[i], OS.heap[(i-1) >> 1]));
+    }
+  }
+}
+
+// position of a job in the scheduling order
+static u1_t sched_pos (osjob_t* job) {
+  for(u1_t k = nsched; k-- > 0; ) {
+    if(&jobs[order[k]] == job) {
+      return k;
+    }
+  }
+  CHECK(0);
+  return 0;
+}
+
+// take the jobs off the heap the way the run loop does, checking the order
+static u1_t drain (void) {
+  u1_t n = 0;
+  osjob_t* prev = NULL;
+  while(OS.njobs) {
+    osjob_t* j = OS.heap[0];
+    heapremove(j);
+    check_heap();
+    CHECK(j->qstate == OSJOB_IDLE);
+    if(prev) {
+      ostime_t d = (u4_t)j->deadline - (u4_t)prev->deadline;
+      CHECK(d >= 0);
+      CHECK(d > 0 || sched_pos(prev) < sched_pos(j));
+    }
+    prev = j;
+    n++;
+  }
+  return n;
+}
+
+static void schedule (u1_t i, ostime_t deadline) {
+  os_setTimedCallback(&jobs[i], deadline, FUNC_ADDR(cb));
+  order[nsched++] = i;
+  check_heap();
+}
+
+int main () {
+  os_init();
+  srand(1);
+
+  // few distinct deadlines, so most jobs tie, some close to the wrap
+  for(u2_t r = 0; r < ROUNDS; r++) {
+    u4_t base = (r & 1) ? 0x7FFFFFF0 : 0;
+    nsched = 0;
+    for(u1_t i = 0; i < JOBS; i++) {
+      schedule(i, (ostime_t)(base + rand() % 8 * 4));
+    }
+    CHECK(drain() == JOBS);
+  }
+
+  // rescheduling a queued job moves it, and it ties behind the others
+  nsched = 0;
+  for(u1_t i = 0; i < JOBS; i++) {
+    schedule(i, 100);
+  }
+  schedule(0, 100);
+  CHECK(OS.njobs == JOBS);
+  CHECK(OS.heap[0] == &jobs[1]);
+  CHECK(drain() == JOBS);
+
+  // clear jobs from the middle of the heap, the rest still runs in order
+  for(u2_t r = 0; r < ROUNDS; r++) {
+    nsched = 0;
+    for(u1_t i = 0; i < JOBS; i++) {
+      schedule(i, rand() % 16);
+    }
+    u1_t left = JOBS;
+    for(u1_t k = 0; k < JOBS / 2; k++) {
+      osjob_t* j = OS.heap[1 + rand() % (OS.njobs - 1)];
+      os_clearCallback(j);
+      CHECK(j->qstate == OSJOB_IDLE);
+      check_heap();
+      left--;
+      // clearing it again, or a job that was never queued, is harmless
+      os_clearCallback(j);
+      CHECK(OS.njobs == left);
+    }
+    CHECK(drain() == left);
+  }
+
+  // a job that was never queued may hold any garbage
+  osjob_t stray;
+  memset(&stray, 0xA5, sizeof(stray));
+  schedule(0, 1);
+  os_clearCallback(&stray);
+  CHECK(OS.njobs == 1 && OS.heap[0] == &jobs[0]);
+
+  // with garbage links, a job that claims to be runnable isn't followed
+  memset(&stray, 0xA5, sizeof(stray));
+  stray.qstate = OSJOB_RUNNABLE;
+  os_setCallback(&jobs[1], FUNC_ADDR(cb));
+  os_clearCallback(&stray);
+  CHECK(OS.runnablejobs == &jobs[1] && OS.runnabletail == &jobs[1]);
+  os_clearCallback(&jobs[1]);
+  CHECK(OS.runnablejobs == NULL && OS.runnabletail == NULL);
+  CHECK(drain() == 1);
+
+  // cost per operation with n jobs queued: schedule one more, cancel a
+  // random one, dispatch the earliest (the run loop's heapremove)
+  static osjob_t bench[BENCH_JOBS];
+  static const u2_t sizes[] = { 4, 64, 1024 };
+  // (less the cost of reading the clock)
+  double t_clock = host_ns();
+  for(u4_t r = 0; r < RUNS; r++) {
+    host_ns();
+  }
+  t_clock = (host_ns() - t_clock) / RUNS;
+  printf("  jobs  schedule  cancel  dispatch (ns, host cpu)\n");
+  for(u1_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+    u2_t n = sizes[s];
+    for(u2_t i = 0; i < n - 1; i++) {
+      os_setTimedCallback(&bench[i], rand(), FUNC_ADDR(cb));
+    }
+    double t_sched = 0, t_cancel = 0, t_disp = 0;
+    for(u4_t r = 0; r < RUNS; r++) {
+      osjob_t* j = &bench[n - 1];
+      ostime_t deadline = rand();
+      double t0 = host_ns();
+      os_setTimedCallback(j, deadline, FUNC_ADDR(cb));
+      double t1 = host_ns();
+      // the job n-1 now sits somewhere in the heap
+      j = OS.heap[rand() % n];
+      os_clearCallback(j);
+      double t2 = host_ns();
+      os_setTimedCallback(j, rand(), FUNC_ADDR(cb));
+      double t3 = host_ns();
+      osjob_t* head = OS.heap[0];
+      heapremove(head);
+      double t4 = host_ns();
+      // keep n - 1 queued with job n-1 idle for the next run
+      if(head != &bench[n - 1]) {
+        os_clearCallback(&bench[n - 1]);
+        os_setTimedCallback(head, rand(), FUNC_ADDR(cb));
+      }
+      CHECK(OS.njobs == n - 1);
+      t_sched += t1 - t0;
+      t_cancel += t2 - t1;
+      t_disp += t4 - t3;
+    }
+    check_heap();
+    printf("  %4u  %8.1f  %6.1f  %8.1f\n", n, t_sched / RUNS - t_clock,
+           t_cancel / RUNS - t_clock, t_disp / RUNS - t_clock);
+    while(OS.njobs) {
+      heapremove(OS.heap[0]);
+    }
+  }
+
+  printf("ok: timer heap order\n");
+  return 0;
+}
@@ -0,0 +1,156 @@
+/*
+ * host test: the radio driver moves frames through the FIFO in single SPI
+ * bursts, and the register shadow saves transactions on repeated setups
+ *
+ * build and run from the repository root:
+ *   gcc -std=gnu99 -Ienzo -Ihost -DCFG_sx1272_radio test/radio_spi_test.c host/hal.c enzo/osenzo.c enzo/enzo.c enzo/aes.c -o radio_spi_test && ./radio_spi_test
+ *
+ * radio.c is included for its register names and counters; it runs on the
+ * host HAL (host/hal.c) against a simulated register file. Bus times are
+ * simulated at HOST_SPI_HZ, CPU times are measured on the host.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "../enzo/radio.c"
+#include "host.h"
+
+#define CHECK(cond) do { if(!(cond)) { printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); exit(1); } } while(0)
+
+enum { RUNS = 10000 };
+
+static u1_t done;
+static void rx_cb (osjob_t* job) { done = 1; }
+static void xfer_cb (void) { done = 1; }
+
+static double host_us (void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static void report (const char* what) {
+  printf("%-10s %3u nss %4u bytes (%3u polled) %u bursts %5.1f us bus %5.1f us cpu\n", what,
+         host_spi.nss, host_spi.bytes, host_spi.polled, host_spi.bursts,
+         host_spi.bus_ns / 1e3, host_spi.cpu_ns / 1e3);
+}
+
+static void tx (void) {
+  os_radio(RADIO_RST);
+  host_spi_reset();
+  os_radio(RADIO_TX);
+}
+
+int main () {
+  os_init();
+  ENZO_reset();
+  ENZO.rps = makeRps(SF12, BW125, CR_4_5, 0, 0);
+  ENZO.dataLen = MAX_LEN_FRAME;
+  for(u1_t i = 0; i < MAX_LEN_FRAME; i++) {
+    ENZO.frame[i] = i ^ 0x5A;
+  }
+
+  // first TX configures the modem, the frame goes down in one burst
+  tx();
+  report("tx");
+  CHECK((host_reg(RegOpMode) & (OPMODE_LORA|OPMODE_MASK)) == (OPMODE_LORA|OPMODE_TX));
+  CHECK(host_reg(LORARegPayloadLength) == MAX_LEN_FRAME);
+  CHECK(memcmp(host_fifo(), ENZO.frame, MAX_LEN_FRAME) == 0);
+  CHECK(host_spi.bursts == 1 && host_spi.burst_bytes == MAX_LEN_FRAME);
+  CHECK(host_spi.polled < host_spi.bytes - MAX_LEN_FRAME + 1);
+  u4_t first = host_spi.nss;
+
+  // the same setup again only writes what the shadow can't vouch for
+  u4_t ops, spiops, saved0, saved1;
+  radio_spiStats(&ops, &spiops, &saved0);
+  tx();
+  report("tx again");
+  radio_spiStats(&ops, &spiops, &saved1);
+  CHECK(host_spi.nss < first);
+  CHECK(saved1 > saved0);
+  CHECK(memcmp(host_fifo(), ENZO.frame, MAX_LEN_FRAME) == 0);
+  u4_t again = host_spi.nss;
+
+  // alternating channels, the new frequency goes down in one burst
+  u4_t freq[2] = { ENZO.freq, ENZO.freq + 1425000 };
+  for(u1_t i = 1; i <= 4; i++) {
+    ENZO.freq = freq[i & 1];
+    tx();
+    u4_t frf = ((u8_t)ENZO.freq << 19) / 32000000;
+    CHECK(host_reg(RegFrfMsb) == (u1_t)(frf >> 16) && host_reg(RegFrfMid) == (u1_t)(frf >> 8) &&
+          host_reg(RegFrfLsb) == (u1_t)frf);
+    CHECK(host_spi.nss == again + 1);
+  }
+  ENZO.freq = freq[0];
+  tx();
+
+  // single RX, the model leaves a frame behind and raises DIO0
+  os_radio(RADIO_RST);
+  ENZO.rxtime = os_getTime();
+  ENZO.rxsyms = 8;
+  ENZO.osjob.func = FUNC_ADDR(rx_cb);
+  os_radio(RADIO_RX);
+  CHECK((host_reg(RegOpMode) & OPMODE_MASK) == OPMODE_RX_SINGLE);
+  u1_t sent[MAX_LEN_FRAME];
+  for(u1_t i = 0; i < MAX_LEN_FRAME; i++) {
+    sent[i] = rand();
+    host_fifo()[0x40 + i] = sent[i];
+  }
+  host_set_reg(LORARegFifoRxCurrentAddr, 0x40);
+  host_set_reg(LORARegRxNbBytes, MAX_LEN_FRAME);
+  host_set_reg(LORARegIrqFlags, IRQ_LORA_RXDONE_MASK|IRQ_LORA_HEADER_MASK);
+  host_set_reg(RegOpMode, OPMODE_LORA|OPMODE_STANDBY);
+  os_clearMem(ENZO.frame, MAX_LEN_FRAME);
+  host_spi_reset();
+  host_dio(0);
+  // deferred to the run loop, no SPI on the IRQ
+  CHECK(radio_irq_pending() && host_spi.bytes == 0);
+  radio_irq_process();
+  report("rx done");
+  CHECK(ENZO.dataLen == MAX_LEN_FRAME && ENZO.crcerr == 0);
+  CHECK(memcmp(ENZO.frame, sent, MAX_LEN_FRAME) == 0);
+  CHECK(host_spi.bursts == 1 && host_spi.burst_bytes == MAX_LEN_FRAME);
+  CHECK(host_reg(LORARegIrqFlags) == 0);
+  CHECK((host_reg(RegOpMode) & OPMODE_MASK) == OPMODE_SLEEP);
+  CHECK(ENZO.osjob.qstate == OSJOB_RUNNABLE);
+  os_clearCallback(&ENZO.osjob);
+
+  // the header of a frame being received is peeked at from the FIFO, as
+  // long as the chip itself is still in RX, whatever the shadow says
+  os_radio(RADIO_RST);
+  os_radio(RADIO_RX);
+  u1_t base = host_reg(LORARegFifoRxBaseAddr);
+  host_set_reg(LORARegIrqFlags, IRQ_LORA_HEADER_MASK);
+  host_set_reg(LORARegFifoRxByteAddr, base + MAX_LEN_FRAME);
+  host_set_reg(RegOpMode, OPMODE_LORA|OPMODE_STANDBY);
+  CHECK(!radio_rx_peek(4));
+  host_set_reg(RegOpMode, OPMODE_LORA|OPMODE_RX_SINGLE);
+  os_clearMem(ENZO.frame, 4);
+  CHECK(radio_rx_peek(4) && memcmp(ENZO.frame, host_fifo() + base, 4) == 0);
+  // and only once the byte after them was written
+  host_set_reg(LORARegFifoRxByteAddr, base + 4);
+  CHECK(!radio_rx_peek(4));
+  host_set_reg(LORARegFifoRxByteAddr, base + 5);
+  CHECK(radio_rx_peek(4));
+  os_radio(RADIO_RST);
+
+  // asynchronous burst completes through its callback
+  host_spi_reset();
+  done = 0;
+  hal_pin_nss(0);
+  hal_spi(RegFifo & 0x7F);
+  hal_spi_xfer(NULL, sent, MAX_LEN_FRAME, xfer_cb);
+  hal_pin_nss(1);
+  CHECK(done && host_spi.async == 1 && host_spi.cpu_ns < host_spi.bus_ns);
+
+  // CPU time of the driver itself, per TX setup
+  double t0 = host_us();
+  for(u4_t i = 0; i < RUNS; i++) {
+    tx();
+  }
+  printf("tx setup   %.2f us host cpu per run\n", (host_us() - t0) / RUNS);
+
+  printf("ok: radio spi\n");
+  return 0;
+}
@@ -0,0 +1,213 @@
+/*
+ * host test: the CAD scan can't miss a beacon preamble, backs off while
+ * there's no network, and reports the time and energy it takes to sync
+ *
+ * build and run from the repository root:
+ *   gcc -std=gnu99 -Ienzo -Istm32 -DCFG_sx1272_radio test/scan_test.c enzo/enzo.c -o scan_test && ./scan_test
+ *
+ * blink.c is included to run its scan state machine; the OS and debug
+ * output are stubbed. The radio is simulated: a CAD takes SCAN_CAD_SYMS
+ * symbols and detects a preamble that is on air all along, the receiver
+ * runs SCAN_SWITCH_us after the CAD and gets the beacon if that is still
+ * within the preamble. The node hears only the root, whose beacon starts
+ * one guard time into every epoch.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "../enzo/blink.c"
+
+// stubs
+static ostime_t now;
+static u1_t radio;        // operation the simulated radio runs
+static u1_t sync_pending; // _sync_job is scheduled
+
+ostime_t os_getTime (void) { return now; }
+void os_setCallback (osjob_t* job, osjobcb_t cb) {
+  os_setTimedCallback(job, now, cb);
+}
+void os_clearCallback (osjob_t* job) {
+  if(job == &_sync_job) {
+    sync_pending = 0;
+  }
+}
+void os_setTimedCallback (osjob_t* job, ostime_t time, osjobcb_t cb) {
+  job->deadline = time;
+  job->func = cb;
+  if(job == &_sync_job) {
+    sync_pending = 1;
+  }
+}
+void os_radio (u1_t mode) { radio = mode; }
+u1_t radio_rand1 (void) { return rand(); }
+s2_t radio_rssi2dBm (u1_t rssi) { return (s2_t)rssi - 139; }
+void debug_char (u1_t c) { }
+void debug_hex (u1_t b) { }
+void debug_buf (const u1_t* buf, u2_t len) { }
+void debug_uint (u4_t v) { }
+void debug_str (const u1_t* str) { }
+void debug_led (u1_t val) { }
+void on_event (event_t ev) { }
+void hal_failed (u1_t* file, u4_t line) {
+  printf("FAIL assert %s:%u\n", file, line);
+  exit(1);
+}
+
+#define CHECK(cond) do { if(!(cond)) { printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); exit(1); } } while(0)
+
+enum { NODE = 5, RUNS = 200 };
+
+static u1_t beacon[MAX_LEN_FRAME];
+static u1_t beacon_len;
+static u1_t network;      // the root is beaconing
+static u4_t cads;
+
+// start of the root's beacon in the epoch of time t
+static ostime_t beacon_start (ostime_t t) {
+  ostime_t epoch = TIME_SLOTS * TIME_SLOT_ticks;
+  return t - t % epoch + SLOT_GUARD_ticks;
+}
+
+static ostime_t symbols (u2_t n) {
+  return us2osticks(n * calcSymTimeUs(ENZO.rps));
+}
+
+// run the simulated radio or the next scan job
+static void step (void) {
+  if(radio == RADIO_CAD) {
+    ostime_t p = beacon_start(now);
+    ostime_t start = now;
+    now += symbols(SCAN_CAD_SYMS);
+    radio = RADIO_RST;
+    cads++;
+    ENZO.rxtime = now;
+    ENZO.cad = network && start >= p && now <= p + symbols(STD_PREAMBLE_LEN);
+    ENZO.osjob.func(&ENZO.osjob);
+  } else if(radio == RADIO_RX) {
+    // only ever started on a detected preamble, which must still be on air
+    ostime_t p = beacon_start(now);
+    CHECK(now + us2osticks(SCAN_SWITCH_us) <= p + symbols(STD_PREAMBLE_LEN));
+    now = p + calcAirTime(ENZO.rps, beacon_len);
+    radio = RADIO_RST;
+    os_copyMem(ENZO.frame, beacon, beacon_len);
+    ENZO.dataLen = beacon_len;
+    ENZO.crcerr = 0;
+    ENZO.rxtime = now;
+    ENZO.osjob.func(&ENZO.osjob);
+  } else {
+    CHECK(sync_pending);
+    sync_pending = 0;
+    if(_sync_job.deadline - now > 0) {
+      now = _sync_job.deadline;
+    }
+    _sync_job.func(&_sync_job);
+  }
+}
+
+static int cmp (const void* a, const void* b) {
+  u4_t x = *(const u4_t*)a, y = *(const u4_t*)b;
+  return x < y ? -1 : x > y;
+}
+
+static void reset (u1_t sf) {
+  BLINK.opmode = 0;
+  blink_reset();
+  ENZO.rps = makeRps(sf, BW125, CR_4_5, 0, 0);
+  radio = RADIO_RST;
+  sync_pending = 0;
+}
+
+int main () {
+  ENZO_reset();
+  blink_init();
+  srand(1);
+
+  // the root's beacon of the first epoch
+  BLINK.nodeid = ROOT_ID;
+  blink_reset();
+  BLINK.slot = 0;
+  _beacon_tx(NULL);
+  beacon_len = ENZO.dataLen;
+  os_copyMem(beacon, ENZO.frame, beacon_len);
+  BLINK.nodeid = NODE;
+
+  ostime_t epoch = TIME_SLOTS * TIME_SLOT_ticks;
+  printf("      CAD every   time to sync (s)     radio on-time to sync (s)\n");
+  printf("sf      (ms)     mean   p90    max     mean   p90    max   CADs\n");
+  for(u1_t sf = SF7; sf <= SF12; sf++) {
+    reset(sf);
+    // one CAD within any preamble, with time to switch to RX before it ends
+    ostime_t interval = _scan_interval();
+    CHECK(interval > 0);
+    CHECK(interval + symbols(SCAN_CAD_SYMS) + us2osticks(SCAN_SWITCH_us) <= symbols(STD_PREAMBLE_LEN));
+
+    // nodes switched on at random points of the epoch all sync on the
+    // first attempt, within an epoch
+    static u4_t t[RUNS], on[RUNS];
+    network = 1;
+    cads = 0;
+    memset(&BLINK.stats, 0, sizeof(BLINK.stats));
+    for(u2_t i = 0; i < RUNS; i++) {
+      reset(sf);
+      now = (ostime_t)(((u8_t)rand() << 16 ^ rand()) % epoch);
+      blink_start_sync();
+      while(BLINK.opmode & OP_SCAN) {
+        step();
+      }
+      CHECK(BLINK.opmode & OP_TRACK);
+      CHECK(BLINK.parent == ROOT_ID && BLINK.hop == 1);
+      CHECK(BLINK.scan_backoff == 0);
+      CHECK(BLINK.slot_time == beacon_start(now) - SLOT_GUARD_ticks);
+      t[i] = now - BLINK.scan_start;
+      on[i] = BLINK.scan_on;
+      CHECK(t[i] <= epoch + calcAirTime(ENZO.rps, beacon_len));
+    }
+    CHECK(BLINK.stats.scan_syncs == RUNS);
+    CHECK(BLINK.stats.scan_cads == cads);
+    qsort(t, RUNS, sizeof(t[0]), cmp);
+    qsort(on, RUNS, sizeof(on[0]), cmp);
+    printf("%2u %9.1f   %6.1f %5.1f %6.1f   %6.1f %5.1f %6.1f %6u\n", 7 + sf - SF7,
+           osticks2ms(interval * 10) / 10.0,
+           BLINK.stats.scan_ticks / (double)RUNS / OSTICKS_PER_SEC,
+           t[RUNS * 9 / 10] / (double)OSTICKS_PER_SEC,
+           BLINK.stats.scan_ticks_max / (double)OSTICKS_PER_SEC,
+           BLINK.stats.scan_on_ticks / (double)RUNS / OSTICKS_PER_SEC,
+           on[RUNS * 9 / 10] / (double)OSTICKS_PER_SEC,
+           BLINK.stats.scan_on_max / (double)OSTICKS_PER_SEC,
+           cads / RUNS);
+  }
+
+  // no network: each attempt samples one epoch, then sleeps twice as
+  // many epochs as the last time, at most SCAN_SLEEP_MAX_s
+  reset(SF12);
+  network = 0;
+  now = 0;
+  blink_start_sync();
+  step();
+  u1_t attempts = 0;
+  ostime_t attempt = now;
+  ostime_t sleep_max = 0;
+  while(attempts < SCAN_BACKOFF_MAX + 2) {
+    step();
+    if(sync_pending && _sync_job.func == FUNC_ADDR(_scan_attempt)) {
+      // backed off
+      CHECK(!(BLINK.opmode & OP_TRACK));
+      CHECK(now - attempt >= epoch && now - attempt < epoch + _scan_interval() + symbols(SCAN_CAD_SYMS));
+      ostime_t sleep = _sync_job.deadline - now;
+      s8_t expect = (s8_t)epoch << (attempts < SCAN_BACKOFF_MAX ? attempts + 1 : SCAN_BACKOFF_MAX);
+      if(expect > sec2osticks(SCAN_SLEEP_MAX_s)) {
+        expect = sec2osticks(SCAN_SLEEP_MAX_s);
+      }
+      CHECK(sleep == expect);
+      sleep_max = sleep;
+      attempts++;
+      step();
+      attempt = now;
+      CHECK(radio == RADIO_CAD);
+    }
+  }
+  printf("backoff: sleeps up to %u s between attempts\n", osticks2ms(sleep_max) / 1000);
+
+  printf("ok: cad scan\n");
+  return 0;
+}
@@ -0,0 +1,162 @@
+/*
+ * host test: nodes whose ids are equal modulo 8 own distinct mini-slots
+ * spread over all of the data slots, a node that hears another one send
+ * in its source mini-slot moves, and nodes only listen where their
+ * children may send
+ *
+ * build and run from the repository root:
+ *   gcc -std=gnu99 -Ienzo -Istm32 -DCFG_sx1272_radio test/slot_test.c enzo/enzo.c -o slot_test && ./slot_test
+ *
+ * blink.c is included to reach its data schedule directly; the OS, radio
+ * and debug output are stubbed.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "../enzo/blink.c"
+
+// stubs
+static osjobcb_t scheduled;
+
+ostime_t os_getTime (void) { return 0; }
+void os_setCallback (osjob_t* job, osjobcb_t cb) { job->func = cb; }
+void os_clearCallback (osjob_t* job) { }
+void os_setTimedCallback (osjob_t* job, ostime_t time, osjobcb_t cb) {
+  job->deadline = time;
+  job->func = cb;
+  scheduled = cb;
+}
+void os_radio (u1_t mode) { }
+u1_t radio_rand1 (void) { return rand(); }
+s2_t radio_rssi2dBm (u1_t rssi) { return (s2_t)rssi - 139; }
+void debug_char (u1_t c) { }
+void debug_hex (u1_t b) { }
+void debug_buf (const u1_t* buf, u2_t len) { }
+void debug_uint (u4_t v) { }
+void debug_str (const u1_t* str) { }
+void debug_led (u1_t val) { }
+void on_event (event_t ev) { }
+void hal_failed (u1_t* file, u4_t line) {
+  printf("FAIL assert %s:%u\n", file, line);
+  exit(1);
+}
+
+#define CHECK(cond) do { if(!(cond)) { printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); exit(1); } } while(0)
+
+enum { ID = 3, IDS = 64 };
+
+// a node's source mini-slot at the given hop
+static u2_t source (u2_t id, u1_t hop, u1_t salt) {
+  BLINK.nodeid = id;
+  BLINK.hop = hop;
+  BLINK.vslot_salt = salt;
+  return _source_vslot();
+}
+
+// the data slot and mini-slot of schedule index v
+static void enter (u2_t v) {
+  BLINK.slot = BEACON_SLOTS + v / BLINK.minislots;
+  BLINK.minislot = v % BLINK.minislots;
+}
+
+static void check_schedule (u1_t sched) {
+  BLINK.cfg.sched = sched;
+  _minislot_setup();
+  // all data mini-slots but the downlink ones are assigned
+  CHECK(BLINK.vslots == DATA_SLOTS * BLINK.minislots - (BLINK.cfg.down ? 1 + BEACON_SLOTS : 0));
+  u2_t size = BLINK.vslots / _vslot_groups(&BLINK.cfg);
+
+  for(u1_t hop = 1; hop <= BEACON_SLOTS; hop++) {
+    // in the group of its hop (or the source half), anywhere in it
+    u2_t first = sched == SCHED_PIPELINE ? _hop_group(hop) * size : 0;
+    u2_t lo = 0xFFFF, hi = 0;
+    for(u2_t id = 1; id <= IDS; id++) {
+      u2_t v = source(id, hop, 0);
+      CHECK(v >= first && v < first + size);
+      lo = v < lo ? v : lo;
+      hi = v > hi ? v : hi;
+      if(sched == SCHED_NODEID) {
+        CHECK(_forward_vslot() == size + v);
+      }
+    }
+    CHECK(hi - lo + 1 > size / 2);
+  }
+
+  // ids equal modulo 8 no longer share their mini-slots by construction:
+  // find one that shares ID's by hash, and one that doesn't
+  u2_t v = source(ID, 1, 0);
+  u2_t same = 0, other = 0;
+  for(u2_t id = ID + 8; (same == 0 || other == 0) && id < 0xFFF0; id += 8) {
+    if(source(id, 1, 0) == v) {
+      same = same ? same : id;
+    } else {
+      other = other ? other : id;
+    }
+  }
+  CHECK(same != 0 && other != 0);
+  printf("%s: %u mini-slots, %u per %s; %u and %u share one, %u and %u don't\n",
+         sched == SCHED_PIPELINE ? "pipeline" : "node id ", BLINK.vslots, size,
+         sched == SCHED_PIPELINE ? "hop" : "half", ID, same, ID, other);
+
+  // ID listens in its source mini-slot with nothing to send, and hears
+  // the other node's frame there: it moves, the other node stays
+  source(ID, 1, 0);
+  enter(v);
+  CHECK(!_tx_ready() && _vslot_listen(v));
+  BLINK.opmode |= OP_TRACK|OP_RXDATA;
+  data_msg_t* d = (data_msg_t*)ENZO.frame;
+  d->header.type = DATA;
+  d->header.ackreq = 0;
+  d->header.hop = 1;
+  d->header.dest = ROOT_ID;
+  d->header.src = same;
+  record_t r = { .hdr = { .len = 2, .seq = 1, .src = same } };
+  ENZO.dataLen = SIZEOFEXPR(header_t) + _record_pack(d->records, &r, same);
+  u4_t shared = BLINK.stats.slot_shared;
+  _rx_data_done(NULL);
+  CHECK(BLINK.stats.slot_shared == shared + 1 && BLINK.vslot_salt == 1);
+  CHECK(source(ID, 1, 1) != source(same, 1, 0));
+}
+
+int main () {
+  ENZO_reset();
+  blink_init();
+  BLINK.nodeid = ID;
+  blink_reset();
+  check_schedule(SCHED_NODEID);
+  check_schedule(SCHED_PIPELINE);
+
+  // at SF9, several mini-slots per data slot
+  ENZO.rps = MAKERPS(SF9, BW125, CR_4_5, 0, 0);
+  check_schedule(SCHED_NODEID);
+  check_schedule(SCHED_PIPELINE);
+  CHECK(BLINK.minislots > 1);
+
+  // in the pipeline, a node at hop 2 listens in the group of hop 3 and its
+  // own source mini-slot only, and skips ahead to them
+  u2_t size = BLINK.vslots / BEACON_SLOTS;
+  u2_t own = source(ID, 2, 0);
+  u2_t listened = 0;
+  for(u2_t v = 0; v < BLINK.vslots; v++) {
+    u1_t child = v / size == _hop_group(3);
+    CHECK(_vslot_listen(v) == (child || v == own));
+    listened += _vslot_listen(v);
+  }
+  CHECK(listened == size + 1);
+  for(u2_t v = 0; v < BLINK.vslots; v += BLINK.minislots) {
+    enter(v);
+    scheduled = NULL;
+    _schedule_minislot();
+    u2_t w = _vslot(BLINK.minislot);
+    if(scheduled != NULL) {
+      CHECK(scheduled == FUNC_ADDR(_data_rx) && (_vslot_listen(w) || _is_down_vslot(w)));
+    }
+    // nothing skipped that we'd listen in
+    for(u2_t k = v; k < w; k++) {
+      CHECK(!_vslot_listen(k));
+    }
+  }
+
+  printf("ok: mini-slot assignment\n");
+  return 0;
+}